@@ -8,7 +8,7 @@ static void update_maxdiff(double dx, double dy, double* maxabsdiff) {
     *maxabsdiff = absdiff;
 }
 
-int read_doubles_from_file(int n, double* p, const char* fileName) {
+int read_doubles_from_file(long n, double* p, const char* fileName) {
   /* Open input file and determine its size. */
   FILE* input_file = fopen(fileName, "rb");
   if(!input_file) {
@@ -22,7 +22,7 @@ int read_doubles_from_file(int n, double* p, const char* fileName) {
   fseek(input_file, 0L, SEEK_SET);
   if(fileSize != n * sizeof(double)) {
     printf("read_doubles_from_file error: size of input file '%s' does not match the given n.\n", fileName);
-    printf("For n = %d the file size is expected to be (n * sizeof(double)) = %lu but the actual file size is %lu.\n",
+    printf("For n = %ld the file size is expected to be (n * sizeof(double)) = %zu but the actual file size is %zu.\n",
 	   n, n * sizeof(double), fileSize);
     return -1;
   }
@@ -45,11 +45,11 @@ int read_doubles_from_file(int n, double* p, const char* fileName) {
 /* The idea with the check_that_numbers_seem_OK() function is to check
    that there are no strange numbers like "nan" that may give problems
    when we try to compare the numbers later. */
-int check_that_numbers_seem_OK(int n, double* buf) {
+int check_that_numbers_seem_OK(long n, double* buf) {
   const double minAllowedValue = -1e10;
   const double maxAllowedValue = 1e10;
-  int OKcount = 0;
-  int i;
+  long OKcount = 0;
+  long i;
   for(i = 0; i < n; i++) {
     double a = buf[i];
     if(a >= minAllowedValue && a <= maxAllowedValue)
@@ -66,14 +66,19 @@ int main(int argc, const char* argv[]) {
     printf("Give 3 input args: N gal1.gal gal2.gal\n");
     return -1;
   }
-  int N = atoi(argv[1]);
+  long N = atol(argv[1]);
   const char* fileName1 = argv[2];
   const char* fileName2 = argv[3];
-  printf("N = %d\n", N);
+  printf("N = %ld\n", N);
   printf("fileName1 = '%s'\n", fileName1);
   printf("fileName2 = '%s'\n", fileName2);
-  /* Read files. */
-  double buf1[6*N];
+  /* Read files. Large N does not fit on the stack, so use the heap. */
+  double* buf1 = (double*)malloc(6 * N * sizeof(double));
+  double* buf2 = (double*)malloc(6 * N * sizeof(double));
+  if(!buf1 || !buf2) {
+    printf("Error: failed to allocate buffers for N = %ld.\n", N);
+    return -1;
+  }
   if(read_doubles_from_file(6*N, buf1, fileName1) != 0) {
     printf("Error reading file '%s'\n", fileName1);
     return -1;
@@ -82,7 +87,6 @@ int main(int argc, const char* argv[]) {
     printf("Error: strange numbers found in file '%s'.\n", fileName1);
     return -1;
   }
-  double buf2[6*N];
   if(read_doubles_from_file(6*N, buf2, fileName2) != 0) {
     printf("Error reading file '%s'\n", fileName2);
     return -1;
@@ -94,7 +98,7 @@ int main(int argc, const char* argv[]) {
   /* Compare positions and velocities. */
   double pos_maxdiff = 0;
   double vel_maxdiff = 0;
-  int i;
+  long i;
   for(i = 0; i < N; i++) {
     double pos_dx = buf1[i*6+0] - buf2[i*6+0];
     double pos_dy = buf1[i*6+1] - buf2[i*6+1];
@@ -114,5 +118,7 @@ int main(int argc, const char* argv[]) {
     update_maxdiff(vel_dx, vel_dy, &vel_maxdiff);
   }
   printf("pos_maxdiff = %16.12f\n", pos_maxdiff);
+  free(buf1);
+  free(buf2);
   return 0;
 }
@@ -1,7 +1,9 @@
 #include "galsim.h"
+#include "trace.h"
 #include <time.h>
 
 #define GRAPHICS_FPS 30
+#define DYNAMIC_CHUNK 64 // Particles per chunk with SCHEDULE_DYNAMIC
 
 /*******************************************************************************
 GLOBAL PTHREAD VARIABLES
@@ -15,6 +17,11 @@ STATIC FUNCTION DECLARATIONS
 
 static void* updateParticles(void* arg);
 
+static inline void updateParticleRange(
+		threadData_t* __restrict data,
+		const long iStart,
+		const long iEnd);
+
 static inline void calculateForces(
 		double x,
 		double y,
@@ -24,18 +31,25 @@ static inline void calculateForces(
 		const double delta_t,
 		const double theta_max,
 		double* __restrict a_x,
-		double* __restrict a_y);
+		double* __restrict a_y,
+		unsigned int* __restrict interactions);
+
+static void computeCostZones(
+		const unsigned int* __restrict interactions,
+		const long N,
+		const int n_zones,
+		long* __restrict zoneStart);
 
 static void showGraphics(
 		particles_t* __restrict particles,
-		const int N,
+		const long N,
 		graphicsConstants_t* __restrict graphicsConstants);
 
 /* Debug funcs
-void printParticles(particles_t* particles, int N);
+void printParticles(particles_t* particles, long N);
 double printQuadtree(node_t* node);
-void printTotalMass(particles_t* particles, int N);
-void printCorrectCOM(particles_t* particles, int N);
+void printTotalMass(particles_t* particles, long N);
+void printCorrectCOM(particles_t* particles, long N);
 */
 
 /*******************************************************************************
@@ -48,9 +62,10 @@ void simulate(
 		simulationConstants_t* __restrict simulationConstants) {
 
 	// Extract simulation constants
-	const int N = *simulationConstants->N;
+	const long N = *simulationConstants->N;
 	const int n_threads = *simulationConstants->n_threads;
 	const int nsteps = *simulationConstants->nsteps;
+	const schedule_t schedule = *simulationConstants->schedule;
 
 	// Create root
 	node_t root;
@@ -70,14 +85,24 @@ void simulate(
 	}
 
 	// Compute workload for the threads
-	int workSize;
-	int n_threadsLeftover = N % n_threadsToUse;
+	long workSize;
+	long n_threadsLeftover = N % n_threadsToUse;
 	if (n_threadsLeftover) {
 		workSize = (N - n_threadsLeftover)/n_threadsToUse;
 	} else {
 		workSize = N/n_threadsToUse;
 	}
 
+	// Interactions per particle during the last step, one each to begin with
+	unsigned int* interactions =
+			(unsigned int*) malloc(N * sizeof(unsigned int));
+	long zoneStart[n_threadsToUse + 1];
+	long nextIndex;
+	long i;
+	for (i = 0; i < N; i++) {
+		interactions[i] = 1;
+	}
+
 	// Create thread data
 	unsigned int j;
 	for (j = 0; j < n_threadsToUse - 1; j++) {
@@ -88,6 +113,10 @@ void simulate(
 		data[j]->simulationConstants = simulationConstants;
 		data[j]->iStart = j * workSize;
 		data[j]->iEnd = data[j]->iStart + workSize;
+		data[j]->interactions = interactions;
+		data[j]->thread = j;
+		data[j]->nextIndex =
+				schedule == SCHEDULE_DYNAMIC ? &nextIndex : NULL;
 	}
 	// Create last thread that includes leftover computations
 	data[j] = (threadData_t*) malloc(sizeof(threadData_t));
@@ -96,32 +125,56 @@ void simulate(
 	data[j]->simulationConstants = simulationConstants;
 	data[j]->iStart = N - workSize - n_threadsLeftover;
 	data[j]->iEnd = N;
+	data[j]->interactions = interactions;
+	data[j]->thread = j;
+	data[j]->nextIndex = schedule == SCHEDULE_DYNAMIC ? &nextIndex : NULL;
 
-	// Simulate
-	unsigned int i;
+	// Simulate. The main thread traces after the workers.
+	const int mainThread = n_threads;
 	for (i = 0; i < nsteps; i++) {
 
 		// Build quadtree
+		traceBegin(mainThread, "build");
 		buildQuadtree(particles, N, &root);
 
+		// Split work between threads
+		if (schedule == SCHEDULE_COSTZONE) {
+			// Zones of equal cost using last step's interaction counts
+			computeCostZones(interactions, N, n_threadsToUse, zoneStart);
+			for (j = 0; j < n_threadsToUse; j++) {
+				data[j]->iStart = zoneStart[j];
+				data[j]->iEnd = zoneStart[j + 1];
+			}
+		} else if (schedule == SCHEDULE_DYNAMIC) {
+			nextIndex = 0;
+		}
+		traceEnd(mainThread, "build");
+
 		// Create threads
+		traceBegin(mainThread, "create");
 		for (j = 0; j < n_threadsToUse; j++) {
 			pthread_create(&threads[j], NULL, updateParticles, (void*) data[j]);
 		}
+		traceEnd(mainThread, "create");
 
 		// Join threads
+		traceBegin(mainThread, "join");
 		for (j = 0; j < n_threadsToUse; j++) {
 			pthread_join(threads[j], NULL);
 		}
+		traceEnd(mainThread, "join");
 
 		// Free quadtree
+		traceBegin(mainThread, "free");
 		freeQuadtree(&root);
+		traceEnd(mainThread, "free");
 	}
 
 	// Free thread data
 	for(i = 0; i < n_threadsToUse; i++) {
 		free(data[i]);
 	}
+	free(interactions);
 
 }
 
@@ -132,7 +185,7 @@ void simulateWithGraphics(
 		graphicsConstants_t* graphicsConstants) {
 
 	// Simulation constants
-	const int N = *simulationConstants->N;
+	const long N = *simulationConstants->N;
 	const int n_threads = *simulationConstants->n_threads;
 	const int nsteps = *simulationConstants->nsteps;
 
@@ -151,14 +204,18 @@ void simulateWithGraphics(
 	threadData_t** data = (threadData_t**) malloc(n_threads*sizeof(threadData_t*));
 
 	// Compute workload for the threads
-	int workSize;
-	int n_threadsLeftover = N % n_threads;
+	long workSize;
+	long n_threadsLeftover = N % n_threads;
 	if (n_threadsLeftover) {
 		workSize = (N - n_threadsLeftover)/n_threads;
 	} else {
 		workSize = N/n_threads;
 	}
 
+	// Interaction counts are only used for cost zones, which are not used here
+	unsigned int* interactions =
+			(unsigned int*) malloc(N * sizeof(unsigned int));
+
 	// Create thread data
 	unsigned int i;
 	unsigned int j;
@@ -171,6 +228,9 @@ void simulateWithGraphics(
 		data[j]->simulationConstants = simulationConstants;
 		data[j]->iStart = j * workSize;
 		data[j]->iEnd = data[j]->iStart + workSize;
+		data[j]->interactions = interactions;
+		data[j]->thread = j;
+		data[j]->nextIndex = NULL;
 	}
 	// Create last thread that includes leftover computations
 	data[j] = (threadData_t*) malloc(sizeof(threadData_t));
@@ -179,6 +239,9 @@ void simulateWithGraphics(
 	data[j]->simulationConstants = simulationConstants;
 	data[j]->iStart = N - workSize - n_threadsLeftover;
 	data[j]->iEnd = N;
+	data[j]->interactions = interactions;
+	data[j]->thread = j;
+	data[j]->nextIndex = NULL;
 
 	// Simulate
 	void* status;
@@ -217,6 +280,7 @@ void simulateWithGraphics(
 		free(data[i]);
 	}
 	free(data);
+	free(interactions);
 
 	// Free root
 	free(root);
@@ -234,6 +298,31 @@ STATIC FUNCTION DEFINITIONS
 static void* updateParticles(void* arg) {
 
 	threadData_t* data = (threadData_t*) arg;
+	traceBegin(data->thread, "force");
+
+	if (data->nextIndex) {
+		// Claim chunks of particles until none are left
+		const long N = *(data->simulationConstants->N);
+		long iStart;
+		while ((iStart = __sync_fetch_and_add(data->nextIndex, DYNAMIC_CHUNK))
+				< N) {
+			const long iEnd = iStart + DYNAMIC_CHUNK < N ?
+					iStart + DYNAMIC_CHUNK : N;
+			updateParticleRange(data, iStart, iEnd);
+		}
+	} else {
+		// Fixed range given by the main thread
+		updateParticleRange(data, data->iStart, data->iEnd);
+	}
+	traceEnd(data->thread, "force");
+	pthread_exit(NULL);
+}
+
+// Updates acceleration, velocity and position of particles iStart to iEnd
+static inline void updateParticleRange(
+		threadData_t* __restrict data,
+		const long iStart,
+		const long iEnd) {
 
 	// Get some constants on stack for speedup
 	const double G = *(data->simulationConstants->G);
@@ -246,8 +335,8 @@ static void* updateParticles(void* arg) {
 	double a_y; // y-acceleration
 
 	// Loop remaining particles
-	unsigned int i;
-	for (i = data->iStart; i < data->iEnd; i++) {
+	long i;
+	for (i = iStart; i < iEnd; i++) {
 
 		// Set acceleration to zero
 		a_x = 0.0;
@@ -256,11 +345,12 @@ static void* updateParticles(void* arg) {
 		const double y = data->particles->y[i];
 
 		// Update acceleration
+		data->interactions[i] = 0;
 		calculateForces(
 				x, y,
 				data->root,
 				G, eps0, delta_t, theta_max,
-				&a_x, &a_y);
+				&a_x, &a_y, &data->interactions[i]);
 
 		// Update velocity
 		data->particles->v_x[i] += -G * delta_t * a_x;
@@ -270,7 +360,6 @@ static void* updateParticles(void* arg) {
 		data->particles->x[i] += delta_t * data->particles->v_x[i];
 		data->particles->y[i] += delta_t * data->particles->v_y[i];
 	}
-	pthread_exit(NULL);
 }
 
 // Calculates force exerted on every particle, recursively
@@ -283,7 +372,8 @@ static inline void calculateForces(
 		const double delta_t,
 		const double theta_max,
 		double* __restrict a_x,
-		double* __restrict a_y) {
+		double* __restrict a_y,
+		unsigned int* __restrict interactions) {
 
 	// Get distance particle<->box
 	double r_x = x - node->xCenterOfMass;
@@ -300,7 +390,7 @@ static inline void calculateForces(
 					x, y,
 					node->children + i,
 					G, eps0, delta_t, theta_max,
-					a_x, a_y);
+					a_x, a_y, interactions);
 		}
 	} else {
 		// Calculate denominator
@@ -309,17 +399,48 @@ static inline void calculateForces(
 		// Acceleration
 		*a_x += node->mass * r_x * denom;
 		*a_y += node->mass * r_y * denom;
+		(*interactions)++;
+	}
+}
+
+// Splits the particles into n_zones contiguous ranges of roughly equal total
+// interaction count. Zone z covers indices zoneStart[z] to zoneStart[z+1].
+static void computeCostZones(
+		const unsigned int* __restrict interactions,
+		const long N,
+		const int n_zones,
+		long* __restrict zoneStart) {
+
+	// Total cost of the last step
+	unsigned long total = 0;
+	long i;
+	for (i = 0; i < N; i++) {
+		total += interactions[i];
+	}
+
+	// Close a zone every time the running cost passes its share
+	unsigned long cost = 0;
+	unsigned int zone = 1;
+	zoneStart[0] = 0;
+	for (i = 0; i < N; i++) {
+		cost += interactions[i];
+		while (zone < n_zones && cost * n_zones >= total * zone) {
+			zoneStart[zone++] = i + 1;
+		}
+	}
+	while (zone <= n_zones) {
+		zoneStart[zone++] = N;
 	}
 }
 
 // Show particles graphically
 static void showGraphics(
 		particles_t* __restrict particles,
-		const int N,
+		const long N,
 		graphicsConstants_t* __restrict graphicsConstants) {
 
 	ClearScreen();
-	unsigned int i;
+	long i;
 	for(i = 0; i < N; i++) {
 		DrawCircle(particles->x[i], particles->y[i], 1, 1,
 				*(graphicsConstants->circleRadius), *(graphicsConstants->circleColour));
@@ -347,7 +468,7 @@ double printQuadtree(node_t* node) {
 	return mass;
 }
 
-void printParticles(particles_t* particles, int N) {
+void printParticles(particles_t* particles, long N) {
 	unsigned int i;
 	for (i = 0; i < N; i++) {
 		//printf("Particle %d:\n", i);
@@ -357,7 +478,7 @@ void printParticles(particles_t* particles, int N) {
 	}
 }
 
-void printTotalMass(particles_t* particles, int N) {
+void printTotalMass(particles_t* particles, long N) {
 	unsigned int i;
 	double mass = 0;
 	for (i = 0; i < N; i++) {
@@ -366,7 +487,7 @@ void printTotalMass(particles_t* particles, int N) {
 	printf("particles total mass = %lf\n", mass);
 }
 
-void printCorrectCOM(particles_t* particles, int N) {
+void printCorrectCOM(particles_t* particles, long N) {
 	double x = 0.0;
 	double y = 0.0;
 	unsigned int i;
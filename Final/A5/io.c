@@ -8,7 +8,7 @@ FUNCTION DEFINITIONS
 int readData(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const char* filename, const int N) {
+		const char* filename, const long N) {
 
 	// Open file
 	FILE* fp = fopen(filename, "r");
@@ -29,7 +29,7 @@ int readData(
 	}
 
 	// Read file
-	unsigned int i;
+	long i;
 	for (i = 0; i < N; i++) {
 		if (
 				fread(&(particles->x[i]), sizeof(double), 1, fp) &&
@@ -40,7 +40,7 @@ int readData(
 				fread(&brightness[i], sizeof(double), 1, fp)) {
 			// Do nothing
 		} else {
-			printf("ERROR: Failed to read particle %d from input file\n", i);
+			printf("ERROR: Failed to read particle %ld from input file\n", i);
 			return 1;
 		}
 	}
@@ -59,7 +59,7 @@ int readData(
 int writeOutput(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const int N) {
+		const long N) {
 
 	// Create file to write
 	FILE* fp = fopen("result.gal", "w");
@@ -71,7 +71,7 @@ int writeOutput(
 	}
 
 	// Write to file
-	unsigned int i;
+	long i;
 	for (i = 0; i < N; i++) {
 		if (
 				fwrite(&(particles->x[i]), sizeof(double), 1, fp) &&
@@ -82,7 +82,7 @@ int writeOutput(
 				fwrite(&brightness[i], sizeof(double), 1, fp)) {
 			// Do nothing
 		} else {
-			printf("ERROR: Failed to write particle %d to output file\n", i);
+			printf("ERROR: Failed to write particle %ld to output file\n", i);
 			return 1;
 		}
 	}
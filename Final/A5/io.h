@@ -23,7 +23,7 @@
  int readData(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const char* filename, const int N);
+		const char* filename, const long N);
 
 /**
  * Writes current state of all particles to output file "result.gal".
@@ -35,4 +35,4 @@
  int writeOutput(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const int N);
+		const long N);
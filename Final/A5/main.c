@@ -1,5 +1,10 @@
 // RUN BY:
 // time ./galsim 05000 ../input_data/ellipse_N_05000.gal 100 0.00001 0.1 0 1
+//
+// Optional flags after the positional arguments:
+// --schedule costzone|dynamic|static   Work distribution (default costzone)
+// --trace <file>                       Write a timeline of the phases of every
+//                                      thread as Chrome trace-event JSON
 
 // ./galsim 2 ../input_data/circles_N_2.gal 100 0.00001 0.1 0
 // ./galsim 4 ../input_data/circles_N_4.gal 100 0.00001 0.1 0
@@ -22,32 +27,62 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "modules.h"
 #include "graphics.h"
 #include "galsim.h"
 #include "io.h"
 #include "quadtree.h"
+#include "trace.h"
+
+#define TRACE_EVENTS_PER_STEP 8 // Trace buffer of every thread, per step
 
 /**
  * Main function
  *
  */
 int main(int argc, char const *argv[]) {
+
 	// Check proper number of input arguments
-	if (argc != 8) {
+	if (argc < 8) {
 		printf("%s\n", "Input error: Expected 7 input arguments");
 		return 1;
 	}
 
 	// Read input from command line
 	const char* program = argv[0];	// Used to return graphics errors
-	const int N = atoi(argv[1]); // Nr of stars to simulate
+	const long N = atol(argv[1]); // Nr of stars to simulate
 	const char* filename = argv[2]; // Filename
 	const int nsteps = atoi(argv[3]); // Nr of filesteps
 	const double delta_t = atof(argv[4]); // Timestep
 	const double theta_max = atof(argv[5]);
 	const int graphics = atoi(argv[6]); // Graphics on/off as 1/0
-	const int n_threads = atoi(argv[7]);
+	const int n_threads = atoi(argv[7]); // Number of threads
+
+	// Read optional flags from command line
+	schedule_t schedule = SCHEDULE_COSTZONE;
+	const char* traceFilename = NULL;
+	unsigned int i;
+	for (i = 8; i < argc; i++) {
+		if (!strcmp(argv[i], "--schedule") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "costzone")) {
+				schedule = SCHEDULE_COSTZONE;
+			} else if (!strcmp(argv[i], "dynamic")) {
+				schedule = SCHEDULE_DYNAMIC;
+			} else if (!strcmp(argv[i], "static")) {
+				schedule = SCHEDULE_STATIC;
+			} else {
+				printf("Input error: Unknown schedule %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			traceFilename = argv[++i];
+		} else {
+			printf("Input error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
 
 	// Constants for the simulation
 	const double G = 100.0/N; // Gravitational constant
@@ -66,6 +101,7 @@ int main(int argc, char const *argv[]) {
 	simulationConstants->delta_t = &delta_t;
 	simulationConstants->theta_max = &theta_max;
 	simulationConstants->n_threads = &n_threads;
+	simulationConstants->schedule = &schedule;
 	simulationConstants->G = &G;
 	simulationConstants->eps0 = &eps0;
 
@@ -102,8 +138,18 @@ int main(int argc, char const *argv[]) {
 		// Simulate with graphics
 		simulateWithGraphics(particles, simulationConstants, graphicsConstants);
 	} else {
+		// Record the phases of the workers, and of the main thread last
+		if (traceFilename) {
+			if (traceOpen(traceFilename, n_threads + 1,
+					TRACE_EVENTS_PER_STEP * (long) (nsteps + 1)))
+				return 1;
+			traceName(n_threads, "main");
+		}
+
 		// Simulate movement only (only calculations)
 		simulate(particles, simulationConstants);
+		if (traceClose())
+			return 1;
 	}
 
 	// Write new state of particles to file
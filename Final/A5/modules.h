@@ -27,15 +27,23 @@ typedef struct node {
 
 } node_t;
 
+// Work distribution of the force loop between threads
+typedef enum schedule {
+	SCHEDULE_COSTZONE, // Contiguous zones of equal interaction count
+	SCHEDULE_DYNAMIC, // Threads claim chunks of particles on demand
+	SCHEDULE_STATIC // Contiguous zones of equal particle count
+} schedule_t;
+
 // Input constants
 typedef struct simulationConstants {
 	const double* delta_t; // Timestep
 	const double* theta_max;
 	const double* G; // Gravitational constant
 	const double* eps0; // Plummer sphere constant
-	const int* N; // Nr of stars to simulate
+	const long* N; // Nr of stars to simulate
 	const int* nsteps; // Nr of filesteps
 	const int* n_threads;
+	const schedule_t* schedule;
 } simulationConstants_t;
 
 // Graphics constants
@@ -51,6 +59,9 @@ typedef struct threadData {
 	node_t* root;
 	particles_t* particles;
 	const simulationConstants_t* simulationConstants;
-	unsigned int iStart;
-	unsigned int iEnd;
+	long iStart;
+	long iEnd;
+	unsigned int* interactions; // Interactions per particle, for cost zones
+	long* nextIndex; // Shared chunk counter, NULL unless dynamic
+	int thread; // Index of the worker, for its trace events
 } threadData_t;
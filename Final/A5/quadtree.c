@@ -29,13 +29,13 @@ static void initialize(
 
 void buildQuadtree(
 		particles_t* __restrict particles,
-		const int N,
+		const long N,
 		node_t* __restrict root) {
 
 	// Initialize Root node
 	initialize(root, 0.5, 0.5, 0.5);
 
-	unsigned int i;
+	long i;
 	for (i = 0; i < N; i++) {
 		insert(root, particles->x[i], particles->y[i], particles->mass[i]);
 	}
@@ -16,7 +16,7 @@
  */
 void buildQuadtree(
 		particles_t* __restrict particles,
-		const int N,
+		const long N,
 		node_t* __restrict root);
 
 /**
@@ -0,0 +1,365 @@
+// RUN BY:
+// make galaccuracy
+// ./galaccuracy 3000 ../input_data/ellipse_N_03000.gal --theta 0,0.1,0.2,0.5,1
+// ./galaccuracy 100000 - --generate plummer --budget 1e-3
+//
+// Optional flags after N and the input file:
+// --theta <list>      Comma separated theta_max to sweep (0.05 to 1.5)
+// --threads <k>       Threads of the force walk (all processors)
+// --reps <k>          Timed repetitions, the fastest is kept (3)
+// --sample <k>        Particles with a direct summation reference (10000)
+// --generate <d>      Generate the particles instead of reading the input
+//                     file: uniform, plummer, exponential or collision
+// --seed <s>          Random seed of --generate (1)
+// --budget <e>        Print the cheapest theta_max whose 99th percentile
+//                     error is at most e
+// --output <file>     CSV file (stdout)
+//
+// For every theta_max the CSV has the seconds of one timestep (quadtree
+// build and force walk), the median, 99th percentile and largest relative
+// acceleration error of the sampled particles, and whether the point is on
+// the Pareto frontier: no point is both faster and at most as inaccurate.
+
+/**
+ * Measures the force error of the quadtree against direct summation and the
+ * cost of a timestep, over a sweep of opening criteria.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "modules.h"
+#include "quadtree.h"
+#include "generate.h"
+#include "memory.h"
+#include "timing.h"
+#include "tools.h"
+#include "io.h"
+
+#define MAX_THETAS 64 // Longest --theta list
+#define DYNAMIC_CHUNK 64 // Particles per chunk of the force walk
+
+// One point of the sweep
+typedef struct point {
+	double theta_max;
+	double seconds; // Quadtree build and force walk of every particle
+	double median; // Relative acceleration errors of the sample
+	double p99;
+	double max;
+	int pareto;
+} point_t;
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static void directSum(
+		const particles_t* __restrict particles,
+		const long N,
+		const double eps0,
+		const long* __restrict sample,
+		const long n_sample,
+		double* __restrict a_x,
+		double* __restrict a_y);
+
+static double treeStep(
+		particles_t* __restrict particles,
+		const long N,
+		nodePool_t* __restrict pool,
+		const double eps0,
+		const double theta_max,
+		double* __restrict a_x,
+		double* __restrict a_y);
+
+static void markPareto(point_t* points, const int n);
+
+/*******************************************************************************
+  FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Main function
+ *
+ */
+int main(int argc, char const *argv[]) {
+
+	// Check proper number of input arguments
+	if (argc < 3) {
+		printf("%s\n", "Input error: Expected N and input filename");
+		return 1;
+	}
+	const long N = atol(argv[1]);
+	const char* inputFilename = argv[2];
+	if (N < 1) {
+		printf("%s\n", "Input error: N must be positive");
+		return 1;
+	}
+
+	// Read optional flags from command line
+	double thetas[MAX_THETAS] = { 0.05, 0.1, 0.2, 0.3, 0.5, 0.7, 1.0, 1.5 };
+	int n_thetas = 8;
+	int n_threads = omp_get_num_procs();
+	int reps = 3;
+	long n_sample = 10000;
+	int generate = 0;
+	distribution_t distribution = DISTRIBUTION_UNIFORM;
+	unsigned long seed = 1;
+	double budget = -1.0;
+	const char* outputFilename = NULL;
+	unsigned int i;
+	for (i = 3; i < argc; i++) {
+		if (!strcmp(argv[i], "--theta") && i + 1 < argc) {
+			n_thetas = parseCheckedList(argv[++i], thetas, MAX_THETAS, 0, 0);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			n_threads = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+			reps = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--sample") && i + 1 < argc) {
+			n_sample = atol(argv[++i]);
+		} else if (!strcmp(argv[i], "--generate") && i + 1 < argc) {
+			generate = 1;
+			i++;
+			if (!strcmp(argv[i], "uniform")) {
+				distribution = DISTRIBUTION_UNIFORM;
+			} else if (!strcmp(argv[i], "plummer")) {
+				distribution = DISTRIBUTION_PLUMMER;
+			} else if (!strcmp(argv[i], "exponential")) {
+				distribution = DISTRIBUTION_EXPONENTIAL;
+			} else if (!strcmp(argv[i], "collision")) {
+				distribution = DISTRIBUTION_COLLISION;
+			} else {
+				printf("Input error: Unknown distribution %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--budget") && i + 1 < argc) {
+			budget = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+			outputFilename = argv[++i];
+		} else {
+			printf("Input error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (n_thetas < 1 || n_threads < 1 || reps < 1 || n_sample < 1) {
+		printf("%s\n", "Input error: Empty or invalid sweep, or no sample");
+		return 1;
+	}
+	if (n_sample > N) {
+		n_sample = N;
+	}
+	omp_set_num_threads(n_threads);
+
+	// Read or generate the particles
+	const double G = 100.0 / N;
+	const double eps0 = 0.001;
+	particles_t particles;
+	double* brightness;
+	if (allocateParticles(&particles, &brightness, N, 1)) {
+		printf("ERROR: Malloc failure");
+		return 1;
+	}
+	if (generate) {
+		generateParticles(&particles, brightness, N, G, eps0, distribution, 2,
+				seed);
+	} else if (readData(&particles, brightness, inputFilename, N)) {
+		return 1;
+	}
+
+	// Direct summation reference of evenly spaced particles
+	long* sample = (long*) malloc(n_sample * sizeof(long));
+	double* ref_x = (double*) malloc(n_sample * sizeof(double));
+	double* ref_y = (double*) malloc(n_sample * sizeof(double));
+	double* a_x = (double*) malloc(N * sizeof(double));
+	double* a_y = (double*) malloc(N * sizeof(double));
+	double* errors = (double*) malloc(n_sample * sizeof(double));
+	nodePool_t pool;
+	if (!(sample && ref_x && ref_y && a_x && a_y && errors)
+			|| createNodePool(&pool, N, 1)) {
+		printf("ERROR: Malloc failure");
+		return 1;
+	}
+	long k;
+	for (k = 0; k < n_sample; k++) {
+		sample[k] = k * N / n_sample;
+	}
+	directSum(&particles, N, eps0, sample, n_sample, ref_x, ref_y);
+
+	// Sweep
+	point_t points[MAX_THETAS];
+	unsigned int t;
+	for (t = 0; t < n_thetas; t++) {
+		point_t* point = points + t;
+		point->theta_max = thetas[t];
+		point->seconds = -1.0;
+		int rep;
+		for (rep = 0; rep < reps; rep++) {
+			const double seconds = treeStep(&particles, N, &pool, eps0,
+					thetas[t], a_x, a_y);
+			if (point->seconds < 0.0 || seconds < point->seconds) {
+				point->seconds = seconds;
+			}
+		}
+		for (k = 0; k < n_sample; k++) {
+			const long j = sample[k];
+			const double d_x = a_x[j] - ref_x[k];
+			const double d_y = a_y[j] - ref_y[k];
+			const double norm = sqrt(ref_x[k]*ref_x[k] + ref_y[k]*ref_y[k]);
+			errors[k] = sqrt(d_x*d_x + d_y*d_y) / (norm > 0.0 ? norm : 1.0);
+		}
+		qsort(errors, n_sample, sizeof(double), compareDoubles);
+		point->median = errors[n_sample / 2];
+		point->p99 = errors[(long) ceil(0.99 * n_sample) - 1];
+		point->max = errors[n_sample - 1];
+	}
+	markPareto(points, n_thetas);
+
+	// Report
+	FILE* fp = outputFilename ? fopen(outputFilename, "w") : stdout;
+	if (!fp) {
+		printf("%s\n", "ERROR: Failed to open output file.");
+		return 1;
+	}
+	fprintf(fp, "theta,threads,seconds_per_step,median_error,p99_error,"
+			"max_error,pareto\n");
+	for (t = 0; t < n_thetas; t++) {
+		fprintf(fp, "%g,%d,%.9f,%.6e,%.6e,%.6e,%d\n", points[t].theta_max,
+				n_threads, points[t].seconds, points[t].median, points[t].p99,
+				points[t].max, points[t].pareto);
+	}
+	if (fp != stdout && fclose(fp)) {
+		printf("%s\n", "ERROR: Failed to write output file.");
+		return 1;
+	}
+	if (budget >= 0.0) {
+		int best = -1;
+		for (t = 0; t < n_thetas; t++) {
+			if (points[t].p99 <= budget
+					&& (best < 0 || points[t].seconds < points[best].seconds)) {
+				best = t;
+			}
+		}
+		if (best < 0) {
+			printf("No theta_max has a 99th percentile error of at most %g\n",
+					budget);
+		} else {
+			printf("Cheapest within %g: theta_max %g, %.6f s per step, "
+					"99th percentile error %.3e\n", budget,
+					points[best].theta_max, points[best].seconds,
+					points[best].p99);
+		}
+	}
+
+	freeNodePool(&pool);
+	freeParticles(&particles, N);
+	free(sample);
+	free(ref_x);
+	free(ref_y);
+	free(a_x);
+	free(a_y);
+	free(errors);
+
+	return 0;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Sums the acceleration of the sampled particles over all particles, with
+ * the softening of calculateForces() and without G, as a_x and a_y of the
+ * quadtree.
+ */
+static void directSum(
+		const particles_t* __restrict particles,
+		const long N,
+		const double eps0,
+		const long* __restrict sample,
+		const long n_sample,
+		double* __restrict a_x,
+		double* __restrict a_y) {
+
+	long k;
+	#pragma omp parallel for schedule(dynamic, DYNAMIC_CHUNK)
+	for (k = 0; k < n_sample; k++) {
+		const double x = particles->x[sample[k]];
+		const double y = particles->y[sample[k]];
+		double sum_x = 0.0;
+		double sum_y = 0.0;
+		long j;
+		#pragma omp simd reduction(+:sum_x, sum_y)
+		for (j = 0; j < N; j++) {
+			const double r_x = x - particles->x[j];
+			const double r_y = y - particles->y[j];
+			const double denom = sqrt(r_x*r_x + r_y*r_y) + eps0;
+			const double scale = particles->mass[j] / (denom*denom*denom);
+			sum_x += scale * r_x;
+			sum_y += scale * r_y;
+		}
+		a_x[k] = sum_x;
+		a_y[k] = sum_y;
+	}
+}
+
+/**
+ * Builds the quadtree and walks it for every particle, as one timestep of
+ * the simulation, and returns the seconds taken.
+ */
+static double treeStep(
+		particles_t* __restrict particles,
+		const long N,
+		nodePool_t* __restrict pool,
+		const double eps0,
+		const double theta_max,
+		double* __restrict a_x,
+		double* __restrict a_y) {
+
+	const double G = 100.0 / N;
+	const double delta_t = 1e-5;
+	node_t root;
+
+	const double start = wallTime();
+	buildQuadtree(particles, N, &root, pool);
+	long i;
+	#pragma omp parallel for schedule(dynamic, DYNAMIC_CHUNK)
+	for (i = 0; i < N; i++) {
+		unsigned int interactions = 0;
+		a_x[i] = 0.0;
+		a_y[i] = 0.0;
+		calculateForces(
+				particles->x[i], particles->y[i],
+				&root,
+				G, eps0, delta_t, theta_max,
+				a_x + i, a_y + i, &interactions);
+	}
+	const double stop = wallTime();
+	releaseQuadtree(&root, pool);
+
+	return stop - start;
+}
+
+/**
+ * Marks the points that no other point beats in both seconds and 99th
+ * percentile error.
+ */
+static void markPareto(point_t* points, const int n) {
+
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		points[i].pareto = 1;
+		unsigned int j;
+		for (j = 0; j < n; j++) {
+			if (j != i && points[j].seconds <= points[i].seconds
+					&& points[j].p99 <= points[i].p99
+					&& (points[j].seconds < points[i].seconds
+					|| points[j].p99 < points[i].p99)) {
+				points[i].pareto = 0;
+				break;
+			}
+		}
+	}
+}
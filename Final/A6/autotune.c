@@ -0,0 +1,329 @@
+#include "autotune.h"
+#include "galsim.h"
+#include "memory.h"
+#include "tools.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+
+#define AUTOTUNE_STEPS 4 // Timesteps to time every candidate with
+#define AUTOTUNE_REPS 3 // Timed repetitions of every candidate, after a warmup
+#define CPU_MODEL_LENGTH 256
+
+/*******************************************************************************
+  STATIC VARIABLES
+ ******************************************************************************/
+
+// Candidate chunk sizes with SCHEDULE_DYNAMIC
+static const int chunkSizes[] = { 16, 64, 256 };
+
+// Names of the schedules in the cache file, in schedule_t order
+static const char* scheduleNames[] = { "costzone", "dynamic", "static" };
+
+// Names of the layouts in the cache file, in layout_t order
+static const char* layoutNames[] = { "soa", "tiled" };
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static void readCpuModel(char* model);
+
+static int bucketOf(const long N);
+
+static int readCache(
+		const char* cacheFile,
+		const char* model,
+		const int nBucket,
+		int* n_threads,
+		schedule_t* schedule,
+		int* chunkSize,
+		layout_t* layout);
+
+static void writeCache(
+		const char* cacheFile,
+		const char* model,
+		const int nBucket,
+		const int n_threads,
+		const schedule_t schedule,
+		const int chunkSize,
+		const layout_t layout,
+		const double seconds);
+
+static double timeCandidate(
+		particles_t* __restrict particles,
+		particles_t* __restrict copy,
+		simulationConstants_t* __restrict simulationConstants);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void autotune(
+		particles_t* __restrict particles,
+		simulationConstants_t* __restrict simulationConstants,
+		int* n_threads,
+		schedule_t* schedule,
+		int* chunkSize,
+		layout_t* layout,
+		const char* cacheFile) {
+
+	const long N = *simulationConstants->N;
+	char model[CPU_MODEL_LENGTH];
+	readCpuModel(model);
+	const int nBucket = bucketOf(N);
+
+	// Reuse an earlier result for this CPU and problem size
+	if (readCache(cacheFile, model, nBucket,
+				n_threads, schedule, chunkSize, layout)) {
+		printf("Autotune: cached %d threads, %s schedule, chunk size %d, "
+				"%s layout\n", *n_threads, scheduleNames[*schedule],
+				*chunkSize, layoutNames[*layout]);
+		return;
+	}
+
+	// Time only a few steps of every candidate, without checkpoints
+	const int* nsteps = simulationConstants->nsteps;
+	const int* firstStep = simulationConstants->firstStep;
+	const int* checkpointInterval = simulationConstants->checkpointInterval;
+	const int* captureStep = simulationConstants->captureStep;
+	const int* memoryReport = simulationConstants->memoryReport;
+	const int calibrationSteps = AUTOTUNE_STEPS;
+	const int zero = 0;
+	const int off = -1;
+	simulationConstants->nsteps = &calibrationSteps;
+	simulationConstants->firstStep = &zero;
+	simulationConstants->checkpointInterval = &zero;
+	simulationConstants->captureStep = &off;
+	simulationConstants->memoryReport = &zero;
+
+	// Candidates run on a copy, so the particles are left as they are
+	particles_t copy;
+	if (allocateParticles(&copy, NULL, N, *simulationConstants->hugePages)) {
+		printf("%s\n", "WARNING: Autotune out of memory, settings unchanged");
+		simulationConstants->nsteps = nsteps;
+		simulationConstants->firstStep = firstStep;
+		simulationConstants->checkpointInterval = checkpointInterval;
+		simulationConstants->captureStep = captureStep;
+		simulationConstants->memoryReport = memoryReport;
+		return;
+	}
+
+	// Thread counts 1, 2, 4, ... and the number of processors
+	const int n_procs = omp_get_num_procs();
+	int bestThreads = 1;
+	schedule_t bestSchedule = SCHEDULE_COSTZONE;
+	int bestChunkSize = chunkSizes[0];
+	layout_t bestLayout = LAYOUT_SOA;
+	double bestSeconds = -1.0;
+	int threads = 1;
+	while (1) {
+		unsigned int i;
+		for (i = 0; i < 2 * (2 + sizeof(chunkSizes)/sizeof(int)); i++) {
+
+			// Cost zones, static zones, then dynamic with every chunk size,
+			// first with the SoA and then with the tiled layout
+			const unsigned int s = i % (2 + sizeof(chunkSizes)/sizeof(int));
+			*n_threads = threads;
+			*schedule = s == 0 ? SCHEDULE_COSTZONE :
+					(s == 1 ? SCHEDULE_STATIC : SCHEDULE_DYNAMIC);
+			*chunkSize = s < 2 ? chunkSizes[0] : chunkSizes[s - 2];
+			*layout = s == i ? LAYOUT_SOA : LAYOUT_TILED;
+
+			const double seconds =
+					timeCandidate(particles, &copy, simulationConstants);
+			if (bestSeconds < 0.0 || seconds < bestSeconds) {
+				bestSeconds = seconds;
+				bestThreads = *n_threads;
+				bestSchedule = *schedule;
+				bestChunkSize = *chunkSize;
+				bestLayout = *layout;
+			}
+		}
+
+		// Next thread count
+		if (threads >= n_procs) {
+			break;
+		}
+		threads = 2 * threads < n_procs ? 2 * threads : n_procs;
+	}
+
+	// Use and remember the fastest
+	*n_threads = bestThreads;
+	*schedule = bestSchedule;
+	*chunkSize = bestChunkSize;
+	*layout = bestLayout;
+	simulationConstants->nsteps = nsteps;
+	simulationConstants->firstStep = firstStep;
+	simulationConstants->checkpointInterval = checkpointInterval;
+	simulationConstants->captureStep = captureStep;
+	simulationConstants->memoryReport = memoryReport;
+	writeCache(cacheFile, model, nBucket, bestThreads, bestSchedule,
+			bestChunkSize, bestLayout, bestSeconds);
+	printf("Autotune: picked %d threads, %s schedule, chunk size %d, "
+			"%s layout\n", *n_threads, scheduleNames[*schedule],
+			*chunkSize, layoutNames[*layout]);
+
+	freeParticles(&copy, N);
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Reads the CPU model name from /proc/cpuinfo, the same name as recorded in
+ * best_timing.txt.
+ *
+ * @param model String of CPU_MODEL_LENGTH, set to the model or "unknown".
+ */
+static void readCpuModel(char* model) {
+
+	strcpy(model, "unknown");
+	FILE* fp = fopen("/proc/cpuinfo", "r");
+	if (!fp) {
+		return;
+	}
+	char line[CPU_MODEL_LENGTH + 32];
+	while (fgets(line, sizeof(line), fp)) {
+		if (!strncmp(line, "model name", 10)) {
+			char* value = strchr(line, ':');
+			if (value) {
+				value += 2;
+				value[strcspn(value, "\n")] = '\0';
+				strncpy(model, value, CPU_MODEL_LENGTH - 1);
+				model[CPU_MODEL_LENGTH - 1] = '\0';
+			}
+			break;
+		}
+	}
+	fclose(fp);
+}
+
+/**
+ * Returns the N bucket of the cache, floor(log2(N)).
+ */
+static int bucketOf(const long N) {
+
+	int nBucket = 0;
+	while ((N >> (nBucket + 1)) > 0) {
+		nBucket++;
+	}
+	return nBucket;
+}
+
+/**
+ * Looks up the configuration for model and nBucket in the cache file. Every
+ * line holds: N bucket, threads, schedule, chunk size, layout, seconds, CPU
+ * model.
+ * The last matching line wins. Returns 1 if found, else 0.
+ */
+static int readCache(
+		const char* cacheFile,
+		const char* model,
+		const int nBucket,
+		int* n_threads,
+		schedule_t* schedule,
+		int* chunkSize,
+		layout_t* layout) {
+
+	FILE* fp = fopen(cacheFile, "r");
+	if (!fp) {
+		return 0;
+	}
+
+	int found = 0;
+	char line[CPU_MODEL_LENGTH + 128];
+	while (fgets(line, sizeof(line), fp)) {
+		int lineBucket;
+		int lineThreads;
+		char lineSchedule[16];
+		int lineChunkSize;
+		char lineLayout[16];
+		double seconds;
+		char lineModel[CPU_MODEL_LENGTH];
+		if (sscanf(line, "%d %d %15s %d %15s %lf %255[^\n]",
+					&lineBucket, &lineThreads, lineSchedule, &lineChunkSize,
+					lineLayout, &seconds, lineModel) != 7
+				|| lineBucket != nBucket || strcmp(lineModel, model)) {
+			continue;
+		}
+		unsigned int s;
+		unsigned int l;
+		for (s = 0; s < 3; s++) {
+			for (l = 0; l < 2; l++) {
+				if (!strcmp(lineSchedule, scheduleNames[s])
+						&& !strcmp(lineLayout, layoutNames[l])) {
+					*n_threads = lineThreads;
+					*schedule = (schedule_t) s;
+					*chunkSize = lineChunkSize;
+					*layout = (layout_t) l;
+					found = 1;
+				}
+			}
+		}
+	}
+	fclose(fp);
+
+	return found;
+}
+
+/**
+ * Appends a configuration to the cache file.
+ */
+static void writeCache(
+		const char* cacheFile,
+		const char* model,
+		const int nBucket,
+		const int n_threads,
+		const schedule_t schedule,
+		const int chunkSize,
+		const layout_t layout,
+		const double seconds) {
+
+	FILE* fp = fopen(cacheFile, "a");
+	if (!fp) {
+		printf("WARNING: Failed to write autotune cache %s\n", cacheFile);
+		return;
+	}
+	fprintf(fp, "%d %d %s %d %s %.6f %s\n", nBucket, n_threads,
+			scheduleNames[schedule], chunkSize, layoutNames[layout], seconds,
+			model);
+	fclose(fp);
+}
+
+/**
+ * Times the current configuration on a fresh copy of the particles. One
+ * untimed warmup run is followed by AUTOTUNE_REPS timed runs, so page faults
+ * and the first thread team do not count.
+ *
+ * @return Median wall-clock time of the timed runs in seconds.
+ */
+static double timeCandidate(
+		particles_t* __restrict particles,
+		particles_t* __restrict copy,
+		simulationConstants_t* __restrict simulationConstants) {
+
+	const long N = *simulationConstants->N;
+	double seconds[AUTOTUNE_REPS];
+	int rep;
+	for (rep = -1; rep < AUTOTUNE_REPS; rep++) {
+		memcpy(copy->x, particles->x, N * sizeof(double));
+		memcpy(copy->y, particles->y, N * sizeof(double));
+		memcpy(copy->v_x, particles->v_x, N * sizeof(double));
+		memcpy(copy->v_y, particles->v_y, N * sizeof(double));
+		memcpy(copy->mass, particles->mass, N * sizeof(double));
+
+		// Repetition -1 is the warmup
+		const double start = omp_get_wtime();
+		simulate(copy, NULL, simulationConstants, NULL, NULL, NULL);
+		if (rep >= 0) {
+			seconds[rep] = omp_get_wtime() - start;
+		}
+	}
+
+	repetitionStats_t stats;
+	repetitionStats(seconds, AUTOTUNE_REPS, &stats);
+	return stats.median;
+}
@@ -0,0 +1,34 @@
+/**
+ *	autotune.h
+ *	Contains functions for picking the fastest thread count and schedule
+ *
+ */
+
+#pragma once
+#include "modules.h"
+
+/**
+ * Picks the fastest number of threads, schedule, chunk size and particle
+ * layout for this CPU and problem size. A configuration cached for the same CPU model and N
+ * bucket (floor of log2 N) in the file cacheFile is reused. Otherwise every
+ * candidate is timed for a few steps on a copy of the particles, after a
+ * warmup run and as the median of a few runs, and the fastest is added to
+ * the cache file.
+ *
+ * @param particles           Information about every particle, not changed.
+ * @param simulationConstants Simulation constants, pointing to the four
+ *                            variables below.
+ * @param n_threads           Set to the fastest number of threads.
+ * @param schedule            Set to the fastest schedule.
+ * @param chunkSize           Set to the fastest chunk size.
+ * @param layout              Set to the fastest particle layout.
+ * @param cacheFile           Name of the cache file.
+ */
+void autotune(
+		particles_t* __restrict particles,
+		simulationConstants_t* __restrict simulationConstants,
+		int* n_threads,
+		schedule_t* schedule,
+		int* chunkSize,
+		layout_t* layout,
+		const char* cacheFile);
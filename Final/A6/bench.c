@@ -0,0 +1,392 @@
+// RUN BY:
+// make bench
+// ./galbench --n 1000,100000,10000000 --theta 0.5 --threads 1,4 --output bench.csv
+//
+// Optional flags, lists are comma separated:
+// --n <list>               Particle counts (1000,10000,100000,1000000)
+// --theta <list>           Opening criteria of the force walk (0.25,0.5,1)
+// --threads <list>         Thread counts (1, 2, 4, ... and the processors)
+// --distribution <list>    uniform, plummer, clustered or degenerate (all)
+// --reps <k>               Timed repetitions of every kernel (5)
+// --warmup <k>             Untimed repetitions before them (1)
+// --output <file>          CSV file (stdout)
+//
+// CSV columns: kernel, distribution, N, theta, threads, reps, min, median,
+// mean and standard deviation of the seconds, then particles and
+// interactions per second at the median. The build is timed on one thread
+// and the update does not depend on theta, so those columns are empty.
+
+/**
+ * Times the quadtree build, the force walk and the particle update in
+ * isolation, over a matrix of particle counts, opening criteria, thread
+ * counts and particle distributions.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "modules.h"
+#include "quadtree.h"
+#include "generate.h"
+#include "memory.h"
+#include "timing.h"
+#include "tools.h"
+
+#define MAX_LIST 32 // Longest list of a flag
+#define DEGENERATE_RADIUS 1e-6 // Radius of the degenerate distribution
+#define UNIFORM_RADIUS 0.25 // Radius of the generated uniform disk
+#define CLUSTERS 8 // Galaxies of the clustered distribution
+#define DYNAMIC_CHUNK 64 // Particles per chunk of the force walk
+
+static const char* distributionNames[] =
+		{ "uniform", "plummer", "clustered", "degenerate" };
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static void generate(
+		particles_t* __restrict particles,
+		const long N,
+		const int distribution);
+
+static double timeForce(
+		node_t* __restrict root,
+		particles_t* __restrict particles,
+		const long N,
+		const double theta_max,
+		const int threads,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		unsigned long* __restrict interactions);
+
+static double timeUpdate(
+		particles_t* __restrict particles,
+		const long N,
+		const int threads,
+		const double* __restrict a_x,
+		const double* __restrict a_y);
+
+static void writeRow(
+		FILE* fp,
+		const char* kernel,
+		const int distribution,
+		const long N,
+		const double theta_max,
+		const int threads,
+		double* seconds,
+		const int reps,
+		const double interactions);
+
+/*******************************************************************************
+  FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Main function
+ *
+ */
+int main(int argc, char const *argv[]) {
+
+	// Defaults
+	double counts[MAX_LIST] = { 1e3, 1e4, 1e5, 1e6 };
+	int n_counts = 4;
+	double thetas[MAX_LIST] = { 0.25, 0.5, 1.0 };
+	int n_thetas = 3;
+	double threadCounts[MAX_LIST];
+	int n_threadCounts = 0;
+	const int n_procs = omp_get_num_procs();
+	int threads;
+	for (threads = 1; threads < n_procs && n_threadCounts < MAX_LIST - 1;
+			threads *= 2) {
+		threadCounts[n_threadCounts++] = threads;
+	}
+	threadCounts[n_threadCounts++] = n_procs;
+	int useDistribution[4] = { 1, 1, 1, 1 };
+	int reps = 5;
+	int warmup = 1;
+	const char* outputFilename = NULL;
+
+	// Read optional flags from command line
+	unsigned int i;
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--n") && i + 1 < argc) {
+			n_counts = parseCheckedList(argv[++i], counts, MAX_LIST, 1, 1);
+		} else if (!strcmp(argv[i], "--theta") && i + 1 < argc) {
+			n_thetas = parseCheckedList(argv[++i], thetas, MAX_LIST, 0, 0);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			n_threadCounts = parseCheckedList(argv[++i], threadCounts,
+					MAX_LIST, 1, 1);
+		} else if (!strcmp(argv[i], "--distribution") && i + 1 < argc) {
+			char list[256];
+			strncpy(list, argv[++i], sizeof(list) - 1);
+			list[sizeof(list) - 1] = '\0';
+			unsigned int d;
+			for (d = 0; d < 4; d++) {
+				useDistribution[d] = 0;
+			}
+			char* name;
+			for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+				for (d = 0; d < 4 && strcmp(name, distributionNames[d]); d++);
+				if (d == 4) {
+					printf("Input error: Unknown distribution %s\n", name);
+					return 1;
+				}
+				useDistribution[d] = 1;
+			}
+		} else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+			reps = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+			outputFilename = argv[++i];
+		} else {
+			printf("Input error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (n_counts < 1 || n_thetas < 1 || n_threadCounts < 1 || reps < 1
+			|| warmup < 0) {
+		printf("%s\n", "Input error: Empty or invalid list, or no repetitions");
+		return 1;
+	}
+
+	FILE* fp = outputFilename ? fopen(outputFilename, "w") : stdout;
+	if (!fp) {
+		printf("%s\n", "ERROR: Failed to open output file.");
+		return 1;
+	}
+	fprintf(fp, "kernel,distribution,N,theta,threads,reps,min_s,median_s,"
+			"mean_s,stddev_s,particles_per_s,interactions_per_s\n");
+
+	double seconds[reps];
+	unsigned int d;
+	for (d = 0; d < 4; d++) {
+		if (!useDistribution[d]) {
+			continue;
+		}
+		unsigned int c;
+		for (c = 0; c < n_counts; c++) {
+			const long N = (long) counts[c];
+
+			// Particles, a copy to update, and the accelerations
+			particles_t particles;
+			particles_t moved;
+			double* a_x = (double*) malloc(N * sizeof(double));
+			double* a_y = (double*) malloc(N * sizeof(double));
+			nodePool_t pool;
+			if (allocateParticles(&particles, NULL, N, 1)
+					|| allocateParticles(&moved, NULL, N, 1)
+					|| !(a_x && a_y) || createNodePool(&pool, N, 1)) {
+				printf("ERROR: Malloc failure");
+				return 1;
+			}
+			generate(&particles, N, d);
+			memcpy(moved.x, particles.x, N * sizeof(double));
+			memcpy(moved.y, particles.y, N * sizeof(double));
+			memcpy(moved.v_x, particles.v_x, N * sizeof(double));
+			memcpy(moved.v_y, particles.v_y, N * sizeof(double));
+
+			// Quadtree build, one thread
+			node_t root;
+			int rep;
+			for (rep = -warmup; rep < reps; rep++) {
+				const double start = wallTime();
+				buildQuadtree(&particles, N, &root, &pool);
+				const double stop = wallTime();
+				releaseQuadtree(&root, &pool);
+				if (rep >= 0) {
+					seconds[rep] = stop - start;
+				}
+			}
+			writeRow(fp, "build", d, N, -1.0, 1, seconds, reps, 0.0);
+
+			// Force walk and update over one quadtree
+			buildQuadtree(&particles, N, &root, &pool);
+			unsigned int t;
+			for (t = 0; t < n_threadCounts; t++) {
+				threads = (int) threadCounts[t];
+
+				unsigned int k;
+				for (k = 0; k < n_thetas; k++) {
+					unsigned long interactions = 0;
+					for (rep = -warmup; rep < reps; rep++) {
+						const double time = timeForce(&root, &particles, N,
+								thetas[k], threads, a_x, a_y, &interactions);
+						if (rep >= 0) {
+							seconds[rep] = time;
+						}
+					}
+					writeRow(fp, "force", d, N, thetas[k], threads,
+							seconds, reps, interactions);
+				}
+
+				for (rep = -warmup; rep < reps; rep++) {
+					const double time = timeUpdate(&moved, N, threads,
+							a_x, a_y);
+					if (rep >= 0) {
+						seconds[rep] = time;
+					}
+				}
+				writeRow(fp, "update", d, N, -1.0, threads, seconds, reps, 0.0);
+			}
+			releaseQuadtree(&root, &pool);
+
+			freeNodePool(&pool);
+			freeParticles(&particles, N);
+			freeParticles(&moved, N);
+			free(a_x);
+			free(a_y);
+		}
+	}
+
+	if (fp != stdout && fclose(fp)) {
+		printf("%s\n", "ERROR: Failed to write output file.");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Generates N particles of distribution number distribution. Degenerate
+ * particles are a uniform disk shrunk to DEGENERATE_RADIUS, so the quadtree
+ * is as deep as it gets without coinciding particles.
+ */
+static void generate(
+		particles_t* __restrict particles,
+		const long N,
+		const int distribution) {
+
+	double* brightness = (double*) malloc(N * sizeof(double));
+	const double G = 100.0 / N;
+	const double eps0 = 0.001;
+	switch (distribution) {
+		case 0:
+			generateParticles(particles, brightness, N, G, eps0,
+					DISTRIBUTION_UNIFORM, 1, 1);
+			break;
+		case 1:
+			generateParticles(particles, brightness, N, G, eps0,
+					DISTRIBUTION_PLUMMER, 1, 1);
+			break;
+		case 2:
+			generateParticles(particles, brightness, N, G, eps0,
+					DISTRIBUTION_COLLISION, CLUSTERS, 1);
+			break;
+		default:
+			generateParticles(particles, brightness, N, G, eps0,
+					DISTRIBUTION_UNIFORM, 1, 1);
+			long i;
+			for (i = 0; i < N; i++) {
+				particles->x[i] = 0.5 + (particles->x[i] - 0.5)
+						* DEGENERATE_RADIUS / UNIFORM_RADIUS;
+				particles->y[i] = 0.5 + (particles->y[i] - 0.5)
+						* DEGENERATE_RADIUS / UNIFORM_RADIUS;
+			}
+			break;
+	}
+	free(brightness);
+}
+
+/**
+ * Walks the quadtree for every particle on threads threads, and returns the
+ * seconds taken. Sets the accelerations and the total interactions.
+ */
+static double timeForce(
+		node_t* __restrict root,
+		particles_t* __restrict particles,
+		const long N,
+		const double theta_max,
+		const int threads,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		unsigned long* __restrict interactions) {
+
+	const double G = 100.0 / N;
+	const double eps0 = 0.001;
+	const double delta_t = 1e-5;
+	unsigned long total = 0;
+
+	const double start = wallTime();
+	long i;
+	#pragma omp parallel for schedule(dynamic, DYNAMIC_CHUNK) \
+			num_threads(threads) reduction(+:total)
+	for (i = 0; i < N; i++) {
+		unsigned int count = 0;
+		a_x[i] = 0.0;
+		a_y[i] = 0.0;
+		calculateForces(
+				particles->x[i], particles->y[i],
+				root,
+				G, eps0, delta_t, theta_max,
+				a_x + i, a_y + i, &count);
+		total += count;
+	}
+	const double stop = wallTime();
+
+	*interactions = total;
+	return stop - start;
+}
+
+/**
+ * Updates velocity and position of every particle from the accelerations on
+ * threads threads, as in the simulation, and returns the seconds taken.
+ */
+static double timeUpdate(
+		particles_t* __restrict particles,
+		const long N,
+		const int threads,
+		const double* __restrict a_x,
+		const double* __restrict a_y) {
+
+	const double G = 100.0 / N;
+	const double delta_t = 1e-5;
+
+	const double start = wallTime();
+	long i;
+	#pragma omp parallel for simd schedule(static) num_threads(threads)
+	for (i = 0; i < N; i++) {
+		particles->v_x[i] += -G * delta_t * a_x[i];
+		particles->v_y[i] += -G * delta_t * a_y[i];
+		particles->x[i] += delta_t * particles->v_x[i];
+		particles->y[i] += delta_t * particles->v_y[i];
+	}
+
+	return wallTime() - start;
+}
+
+/**
+ * Writes the statistics of the seconds of every repetition as a CSV row.
+ * Throughputs are taken at the median. Sorts seconds.
+ */
+static void writeRow(
+		FILE* fp,
+		const char* kernel,
+		const int distribution,
+		const long N,
+		const double theta_max,
+		const int threads,
+		double* seconds,
+		const int reps,
+		const double interactions) {
+
+	repetitionStats_t stats;
+	repetitionStats(seconds, reps, &stats);
+
+	fprintf(fp, "%s,%s,%ld,", kernel, distributionNames[distribution], N);
+	if (theta_max >= 0.0) {
+		fprintf(fp, "%g", theta_max);
+	}
+	fprintf(fp, ",%d,%d,%.9f,%.9f,%.9f,%.9f,%.6e,", threads, reps,
+			stats.min, stats.median, stats.mean, stats.stddev, N / stats.median);
+	if (interactions > 0.0) {
+		fprintf(fp, "%.6e", interactions / stats.median);
+	}
+	fprintf(fp, "\n");
+}
@@ -0,0 +1,311 @@
+#include "capture.h"
+#include "quadtree.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CAPTURE_MAGIC "GALCAPT1"
+#define CAPTURE_HEADER 64 // Bytes before the particle columns
+
+// Quadtree node as stored in a capture file
+typedef struct capturedNode {
+	double xCenterOfMass;
+	double yCenterOfMass;
+	double mass;
+	double xCenterOfNode;
+	double yCenterOfNode;
+	double sideHalf;
+	long firstChild; // Index of the first child, 0 for none
+} capturedNode_t;
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static long countNodes(const node_t* node);
+
+static int writeQuadtree(FILE* fp, const node_t* root, const long n_nodes);
+
+static int readQuadtree(
+		node_t* __restrict node,
+		const capturedNode_t* __restrict nodes,
+		const long index,
+		const long n_nodes);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+int writeCapture(
+		const particles_t* __restrict particles,
+		const double* __restrict brightness,
+		const unsigned int* __restrict interactions,
+		const node_t* __restrict root,
+		simulationConstants_t* __restrict simulationConstants,
+		const int step,
+		const char* filename) {
+
+	const long N = *simulationConstants->N;
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) {
+		printf("%s\n", "ERROR: Failed to create capture file.");
+		return 1;
+	}
+
+	// Header with the step and the constants the timestep depends on
+	char header[CAPTURE_HEADER];
+	memset(header, 0, CAPTURE_HEADER);
+	const long n_nodes = root ? countNodes(root) : 0;
+	const long counts[3] = { N, step, n_nodes };
+	const double constants[4] = {
+		*simulationConstants->delta_t,
+		*simulationConstants->theta_max,
+		*simulationConstants->G,
+		*simulationConstants->eps0 };
+	memcpy(header, CAPTURE_MAGIC, 8);
+	memcpy(header + 8, counts, sizeof(counts));
+	memcpy(header + 32, constants, sizeof(constants));
+
+	// Header, particle columns, interactions, then the quadtree
+	const double* columns[6] = { particles->x, particles->y, particles->v_x,
+			particles->v_y, particles->mass, brightness };
+	int failed = fwrite(header, CAPTURE_HEADER, 1, fp) != 1;
+	unsigned int i;
+	for (i = 0; i < 6 && !failed; i++) {
+		failed = fwrite(columns[i], sizeof(double), N, fp) != N;
+	}
+	if (!failed) {
+		failed = fwrite(interactions, sizeof(unsigned int), N, fp) != N;
+	}
+	if (!failed && root) {
+		failed = writeQuadtree(fp, root, n_nodes);
+	}
+	if (fclose(fp) || failed) {
+		printf("%s\n", "ERROR: Failed to write capture file.");
+		return 1;
+	}
+
+	return 0;
+}
+
+int readCapture(capture_t* capture, const char* filename) {
+
+	memset(capture, 0, sizeof(capture_t));
+	FILE* fp = fopen(filename, "rb");
+	if (!fp) {
+		printf("%s\n", "ERROR: Failed to open capture file.");
+		return 1;
+	}
+
+	// Check header
+	char header[CAPTURE_HEADER];
+	long counts[3];
+	double constants[4];
+	if (fread(header, CAPTURE_HEADER, 1, fp) != 1
+			|| memcmp(header, CAPTURE_MAGIC, 8)) {
+		printf("%s\n", "ERROR: Not a capture file.");
+		fclose(fp);
+		return 1;
+	}
+	memcpy(counts, header + 8, sizeof(counts));
+	memcpy(constants, header + 32, sizeof(constants));
+	const long N = counts[0];
+	const long n_nodes = counts[2];
+	if (N < 1 || n_nodes < 0) {
+		printf("%s\n", "ERROR: Capture header is not as expected.");
+		fclose(fp);
+		return 1;
+	}
+	capture->N = N;
+	capture->step = (int) counts[1];
+	capture->delta_t = constants[0];
+	capture->theta_max = constants[1];
+	capture->G = constants[2];
+	capture->eps0 = constants[3];
+
+	// Particle columns and interactions
+	double* columns[6];
+	unsigned int i;
+	for (i = 0; i < 6; i++) {
+		columns[i] = (double*) malloc(N * sizeof(double));
+	}
+	capture->particles.x = columns[0];
+	capture->particles.y = columns[1];
+	capture->particles.v_x = columns[2];
+	capture->particles.v_y = columns[3];
+	capture->particles.mass = columns[4];
+	capture->brightness = columns[5];
+	capture->interactions = (unsigned int*) malloc(N * sizeof(unsigned int));
+	capturedNode_t* nodes = n_nodes ?
+			(capturedNode_t*) malloc(n_nodes * sizeof(capturedNode_t)) : NULL;
+	int failed = 0;
+	for (i = 0; i < 6; i++) {
+		failed |= !columns[i];
+	}
+	if (failed || !capture->interactions || (n_nodes && !nodes)) {
+		printf("ERROR: Malloc failure");
+		free(nodes);
+		freeCapture(capture);
+		fclose(fp);
+		return 1;
+	}
+	for (i = 0; i < 6 && !failed; i++) {
+		failed = fread(columns[i], sizeof(double), N, fp) != N;
+	}
+	if (!failed) {
+		failed = fread(capture->interactions, sizeof(unsigned int), N, fp) != N;
+	}
+
+	// Quadtree, children malloc'd four at a time as by buildQuadtree()
+	if (!failed && n_nodes) {
+		failed = fread(nodes, sizeof(capturedNode_t), n_nodes, fp) != n_nodes
+				|| readQuadtree(&capture->root, nodes, 0, n_nodes);
+		capture->n_nodes = n_nodes;
+	}
+	free(nodes);
+	fclose(fp);
+	if (failed) {
+		printf("%s\n", "ERROR: Capture file is truncated or corrupt.");
+		freeCapture(capture);
+		return 1;
+	}
+
+	return 0;
+}
+
+void freeCapture(capture_t* capture) {
+
+	free(capture->particles.x);
+	free(capture->particles.y);
+	free(capture->particles.v_x);
+	free(capture->particles.v_y);
+	free(capture->particles.mass);
+	free(capture->brightness);
+	free(capture->interactions);
+	if (capture->n_nodes) {
+		freeQuadtree(&capture->root);
+	}
+	memset(capture, 0, sizeof(capture_t));
+}
+
+int sameQuadtree(const node_t* a, const node_t* b) {
+
+	if (a->xCenterOfMass != b->xCenterOfMass
+			|| a->yCenterOfMass != b->yCenterOfMass
+			|| a->mass != b->mass
+			|| a->xCenterOfNode != b->xCenterOfNode
+			|| a->yCenterOfNode != b->yCenterOfNode
+			|| a->sideHalf != b->sideHalf
+			|| !a->children != !b->children) {
+		return 0;
+	}
+	if (a->children) {
+		unsigned int i;
+		for (i = 0; i < 4; i++) {
+			if (!sameQuadtree(a->children + i, b->children + i)) {
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static long countNodes(const node_t* node) {
+
+	long count = 1;
+	if (node->children) {
+		unsigned int i;
+		for (i = 0; i < 4; i++) {
+			count += countNodes(node->children + i);
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Writes the n_nodes nodes of the quadtree below root breadth first, so the
+ * four children of a node follow each other.
+ */
+static int writeQuadtree(FILE* fp, const node_t* root, const long n_nodes) {
+
+	const node_t** queue = (const node_t**) malloc(n_nodes * sizeof(node_t*));
+	if (!queue) {
+		printf("ERROR: Malloc failure");
+		return 1;
+	}
+	queue[0] = root;
+	long queued = 1;
+	long i;
+	for (i = 0; i < n_nodes; i++) {
+		const node_t* node = queue[i];
+		capturedNode_t record = {
+			node->xCenterOfMass, node->yCenterOfMass, node->mass,
+			node->xCenterOfNode, node->yCenterOfNode, node->sideHalf, 0 };
+		if (node->children) {
+			record.firstChild = queued;
+			unsigned int j;
+			for (j = 0; j < 4; j++) {
+				queue[queued++] = node->children + j;
+			}
+		}
+		if (fwrite(&record, sizeof(capturedNode_t), 1, fp) != 1) {
+			free(queue);
+			return 1;
+		}
+	}
+	free(queue);
+
+	return 0;
+}
+
+/**
+ * Sets node from record index of nodes, and its children below it.
+ *
+ * @return Returns 0 on success, else 1 on a bad child index or malloc
+ *         failure. The nodes set so far can be freed with freeQuadtree().
+ */
+static int readQuadtree(
+		node_t* __restrict node,
+		const capturedNode_t* __restrict nodes,
+		const long index,
+		const long n_nodes) {
+
+	const capturedNode_t* record = nodes + index;
+	node->xCenterOfMass = record->xCenterOfMass;
+	node->yCenterOfMass = record->yCenterOfMass;
+	node->mass = record->mass;
+	node->xCenterOfNode = record->xCenterOfNode;
+	node->yCenterOfNode = record->yCenterOfNode;
+	node->sideHalf = record->sideHalf;
+	node->children = NULL;
+	if (!record->firstChild) {
+		return 0;
+	}
+
+	// Children always follow their parent
+	if (record->firstChild <= index || record->firstChild + 4 > n_nodes) {
+		return 1;
+	}
+	node->children = (node_t*) malloc(4 * sizeof(node_t));
+	if (!node->children) {
+		return 1;
+	}
+	unsigned int i;
+	for (i = 0; i < 4; i++) {
+		node->children[i].children = NULL;
+	}
+	for (i = 0; i < 4; i++) {
+		if (readQuadtree(node->children + i, nodes, record->firstChild + i,
+					n_nodes)) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ *	capture.h
+ *	Contains functions for capturing the state of one timestep
+ *
+ *	A capture holds everything the build and force phases of a timestep
+ *	depend on, so galreplay can repeat them on a real galaxy state. Capture
+ *	file layout, all fields 8 bytes unless noted:
+ *	- Header: magic "GALCAPT1", N, step, number of quadtree nodes (0 if the
+ *	  quadtree was not captured), delta_t, theta_max, G and eps0.
+ *	- x, y, v_x, v_y, mass and brightness of every particle, N doubles each.
+ *	- Interactions of every particle during the previous timestep, N 4-byte
+ *	  unsigned ints, which the cost zones of the timestep are split by.
+ *	- Quadtree nodes, root first: centre of mass, mass, centre and half side,
+ *	  then the index of the first of the four children, 0 for none. Children
+ *	  are stored four in a row, in the order of node_t children.
+ */
+
+#pragma once
+#include "modules.h"
+
+// A captured timestep, as read by readCapture()
+typedef struct capture {
+	long N;
+	int step;
+	double delta_t;
+	double theta_max;
+	double G;
+	double eps0;
+	particles_t particles;
+	double* brightness;
+	unsigned int* interactions;
+	node_t root; // Captured quadtree, if n_nodes is nonzero
+	long n_nodes;
+} capture_t;
+
+/**
+ * Writes the state timestep step starts from to "filename".
+ *
+ * @param particles           Information about every particle.
+ * @param brightness          Brightness of every particle.
+ * @param interactions        Interactions of every particle last timestep.
+ * @param root                Quadtree built from particles, or NULL to leave
+ *                            it out.
+ * @param simulationConstants Simulation constants of the run.
+ * @param step                Timestep captured.
+ * @param filename            Capture filename.
+ * @return                    Returns 0 if written successfully, else 1.
+ */
+int writeCapture(
+		const particles_t* __restrict particles,
+		const double* __restrict brightness,
+		const unsigned int* __restrict interactions,
+		const node_t* __restrict root,
+		simulationConstants_t* __restrict simulationConstants,
+		const int step,
+		const char* filename);
+
+/**
+ * Reads a capture written by writeCapture() into capture, allocating the
+ * particles and the quadtree.
+ *
+ * @return Returns 0 if read successfully, else 1.
+ */
+int readCapture(capture_t* capture, const char* filename);
+
+/**
+ * Frees what readCapture() allocated.
+ */
+void freeCapture(capture_t* capture);
+
+/**
+ * Compares two quadtrees node by node.
+ *
+ * @return Returns 1 if they are the same, else 0.
+ */
+int sameQuadtree(const node_t* a, const node_t* b);
@@ -0,0 +1,68 @@
+#!/bin/bash
+# Script for checking that a run restarted from a checkpoint is the same as
+# a run straight through, trajectory included, and that compressed
+# trajectories decode to the frames of a raw one. Also round trips a .gal
+# file through galaxy v2.
+
+DATA=../../A6
+WORK=check.tmp
+
+echo Checking that input_data is available
+ls -l $DATA/input_data/ellipse_N_02000.gal || exit 1
+
+rm -rf $WORK
+mkdir $WORK || exit 1
+
+echo Running 200 steps straight through
+./galsim 2000 $DATA/input_data/ellipse_N_02000.gal 200 1e-5 0.5 0 2 --snapshot 10 --snapshot-file $WORK/straight.galt --output $WORK/straight.gal > /dev/null || exit 1
+
+echo Running 150 steps with a checkpoint at 100, then restarting to 200
+./galsim 2000 $DATA/input_data/ellipse_N_02000.gal 150 1e-5 0.5 0 2 --snapshot 10 --snapshot-file $WORK/restarted.galt --checkpoint 100 --checkpoint-file $WORK/checkpoint.galc --output $WORK/stopped.gal > /dev/null || exit 1
+./galsim 2000 - 200 1e-5 0.5 0 2 --restart $WORK/checkpoint.galc --snapshot 10 --snapshot-file $WORK/restarted.galt --output $WORK/restarted.gal > /dev/null || exit 1
+
+echo Verifying that the restarted result and trajectory are bit-identical
+cmp $WORK/straight.gal $WORK/restarted.gal || exit 1
+cmp $WORK/straight.galt $WORK/restarted.galt || exit 1
+
+echo Writing delta and quantized trajectories of the same run
+ERROR=1e-6
+./galsim 2000 $DATA/input_data/ellipse_N_02000.gal 200 1e-5 0.5 0 2 --snapshot 10 --snapshot-encoding delta --snapshot-file $WORK/delta.galt --output $WORK/delta.gal > /dev/null || exit 1
+./galsim 2000 $DATA/input_data/ellipse_N_02000.gal 200 1e-5 0.5 0 2 --snapshot 10 --snapshot-encoding quantized --snapshot-error $ERROR --snapshot-file $WORK/quantized.galt --output $WORK/quantized.gal > /dev/null || exit 1
+
+echo Verifying every frame: delta bit-identical to raw, quantized within $ERROR
+for frame in $(seq 0 20); do
+	./galconvert $WORK/straight.galt $WORK/raw_frame.gal --frame $frame > /dev/null || exit 1
+	./galconvert $WORK/delta.galt $WORK/delta_frame.gal --frame $frame > /dev/null || exit 1
+	./galconvert $WORK/quantized.galt $WORK/quantized_frame.gal --frame $frame > /dev/null || exit 1
+	cmp $WORK/raw_frame.gal $WORK/delta_frame.gal || exit 1
+
+	# x, y, v_x and v_y of every record within the error, mass and brightness exact
+	paste <(od -An -v -t f8 -w48 $WORK/raw_frame.gal) <(od -An -v -t f8 -w48 $WORK/quantized_frame.gal) \
+		| awk -v error=$ERROR '
+			function abs(v) { return v < 0 ? -v : v }
+			abs($1 - $7) > error || abs($2 - $8) > error || $3 != $9 \
+					|| abs($4 - $10) > error || abs($5 - $11) > error || $6 != $12 { bad++ }
+			END { if (NR == 0 || bad) { print "Frame out of bound in", bad + 0, "records"; exit 1 } }' || exit 1
+done
+
+echo Converting .gal to galaxy v2 and back, verify that the file is unchanged
+for n in 00010 02000 03000; do
+	./galconvert $DATA/input_data/ellipse_N_$n.gal $WORK/ellipse.gal2 || exit 1
+	./galconvert $WORK/ellipse.gal2 $WORK/ellipse.gal || exit 1
+	cmp $DATA/input_data/ellipse_N_$n.gal $WORK/ellipse.gal || exit 1
+done
+
+echo Running from galaxy v2 input, verify that the result matches .gal input
+./galsim 0 $WORK/ellipse.gal2 10 1e-5 0.5 0 2 --output $WORK/from_v2.gal > /dev/null || exit 1
+./galsim 3000 $DATA/input_data/ellipse_N_03000.gal 10 1e-5 0.5 0 2 --output $WORK/from_gal.gal > /dev/null || exit 1
+cmp $WORK/from_v2.gal $WORK/from_gal.gal || exit 1
+./galsim 0 $WORK/ellipse.gal2 10 1e-5 0.5 0 2 --output-format v2 --output $WORK/result.gal2 > /dev/null || exit 1
+./galconvert $WORK/result.gal2 $WORK/result.gal || exit 1
+cmp $WORK/result.gal $WORK/from_gal.gal || exit 1
+
+rm -rf $WORK
+
+# If we get to this point, then all the different tests above have passed.
+echo
+echo All checks passed
+echo
@@ -0,0 +1,380 @@
+#include "codec.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#define CODEC_SLOT (10 * CODEC_BLOCK + 1) // Largest coded block
+#define BLOCK_RAW 0 // Block stored as plain doubles
+#define BLOCK_CODED 1
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static long blocksPerColumn(const long N);
+
+static size_t headerBytes(const long N);
+
+static size_t encodeBlock(
+		codecState_t* state,
+		const double* frame,
+		const long block,
+		unsigned char* out);
+
+static int decodeBlock(
+		codecState_t* state,
+		const unsigned char* in,
+		const size_t size,
+		const long block,
+		double* frame);
+
+static long toInteger(const codecState_t* state, const double value,
+		const int column);
+
+static long predict(const codecState_t* state, const size_t i);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+codecState_t* codecCreate(const long N, const int encoding,
+		const double errorBound) {
+
+	codecState_t* state = (codecState_t*) calloc(1, sizeof(codecState_t));
+	if (!state) {
+		return NULL;
+	}
+	state->N = N;
+	state->encoding = encoding;
+	state->errorBound = errorBound;
+	state->history[0] = (long*) malloc(4 * (size_t) N * sizeof(long));
+	state->history[1] = (long*) malloc(4 * (size_t) N * sizeof(long));
+	if (!(state->history[0] && state->history[1])) {
+		codecFree(state);
+		return NULL;
+	}
+
+	return state;
+}
+
+void codecFree(codecState_t* state) {
+
+	if (state) {
+		free(state->history[0]);
+		free(state->history[1]);
+		free(state);
+	}
+}
+
+size_t codecMaxBytes(const long N) {
+
+	// Blocks that do not shrink are stored raw behind their mode byte
+	return headerBytes(N) + 4 * (size_t) N * sizeof(double)
+			+ 4 * blocksPerColumn(N);
+}
+
+size_t encodeFrame(
+		codecState_t* __restrict state,
+		const double* __restrict frame,
+		const int keyframe,
+		unsigned char* __restrict out,
+		const int threads) {
+
+	const long N = state->N;
+	const long n_blocks = 4 * blocksPerColumn(N);
+	if (keyframe) {
+		state->order = 0;
+	}
+
+	// Quantization grid, fixed from one keyframe to the next. Rounding to the
+	// nearest multiple of the error bound keeps every value within half of it.
+	unsigned int column;
+	if (state->encoding == SNAPSHOT_QUANTIZED && keyframe) {
+		for (column = 0; column < 4; column++) {
+			const double* values = frame + (size_t) column * N;
+			double lowest = N ? values[0] : 0;
+			long i;
+			#pragma omp parallel for reduction(min:lowest) num_threads(threads)
+			for (i = 0; i < N; i++) {
+				lowest = values[i] < lowest ? values[i] : lowest;
+			}
+			state->origin[column] = lowest;
+			state->step[column] = state->errorBound;
+		}
+	}
+
+	// Header
+	const long order = state->order;
+	memcpy(out, &order, sizeof(long));
+	memcpy(out + sizeof(long), state->origin, sizeof(state->origin));
+	memcpy(out + sizeof(long) + sizeof(state->origin), state->step,
+			sizeof(state->step));
+	long* blockSizes = (long*) (out + sizeof(long) + 8 * sizeof(double));
+	size_t size = headerBytes(N);
+
+	// Encode a few blocks per thread at a time into slots, then append them
+	const int slots = 4 * threads;
+	unsigned char* scratch = (unsigned char*) malloc(slots * CODEC_SLOT);
+	size_t* slotSizes = (size_t*) malloc(slots * sizeof(size_t));
+	if (!(scratch && slotSizes)) {
+		free(scratch);
+		free(slotSizes);
+		return 0;
+	}
+	long first;
+	for (first = 0; first < n_blocks; first += slots) {
+		const long last = first + slots < n_blocks ? first + slots : n_blocks;
+
+		long block;
+		#pragma omp parallel for schedule(dynamic) num_threads(threads)
+		for (block = first; block < last; block++) {
+			slotSizes[block - first] = encodeBlock(state, frame, block,
+					scratch + (size_t) (block - first) * CODEC_SLOT);
+		}
+
+		for (block = first; block < last; block++) {
+			memcpy(out + size, scratch + (size_t) (block - first) * CODEC_SLOT,
+					slotSizes[block - first]);
+			blockSizes[block] = slotSizes[block - first];
+			size += slotSizes[block - first];
+		}
+	}
+
+	free(scratch);
+	free(slotSizes);
+
+	// This frame is now the previous one
+	state->older = !state->older;
+	state->order = state->order < 2 ? state->order + 1 : 2;
+
+	return size;
+}
+
+int decodeFrame(
+		codecState_t* __restrict state,
+		const unsigned char* __restrict in,
+		const size_t size,
+		double* __restrict frame) {
+
+	const long N = state->N;
+	const long n_blocks = 4 * blocksPerColumn(N);
+	if (size < headerBytes(N)) {
+		return 1;
+	}
+
+	// Header, the order can only be higher than ours if a keyframe was skipped
+	long order;
+	memcpy(&order, in, sizeof(long));
+	if (order < 0 || order > state->order) {
+		return 1;
+	}
+	state->order = order;
+	memcpy(state->origin, in + sizeof(long), sizeof(state->origin));
+	memcpy(state->step, in + sizeof(long) + sizeof(state->origin),
+			sizeof(state->step));
+	const long* blockSizes = (const long*) (in + sizeof(long)
+			+ 8 * sizeof(double));
+
+	// Start of every block
+	size_t* offsets = (size_t*) malloc((n_blocks + 1) * sizeof(size_t));
+	if (!offsets) {
+		return 1;
+	}
+	offsets[0] = headerBytes(N);
+	long block;
+	for (block = 0; block < n_blocks; block++) {
+		if (blockSizes[block] < 1
+				|| blockSizes[block] > size - offsets[block]) {
+			free(offsets);
+			return 1;
+		}
+		offsets[block + 1] = offsets[block] + blockSizes[block];
+	}
+
+	// Decode blocks in parallel
+	int failed = 0;
+	#pragma omp parallel for schedule(dynamic) reduction(|:failed)
+	for (block = 0; block < n_blocks; block++) {
+		failed |= decodeBlock(state, in + offsets[block], blockSizes[block],
+				block, frame);
+	}
+
+	free(offsets);
+
+	// This frame is now the previous one
+	state->older = !state->older;
+	state->order = state->order < 2 ? state->order + 1 : 2;
+
+	return failed;
+}
+
+int isKeyframe(const unsigned char* in) {
+
+	long order;
+	memcpy(&order, in, sizeof(long));
+
+	return order == 0;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static long blocksPerColumn(const long N) {
+
+	return (N + CODEC_BLOCK - 1) / CODEC_BLOCK;
+}
+
+/**
+ * Bytes of the payload header: prediction order, quantization grid and the
+ * size of every block.
+ */
+static size_t headerBytes(const long N) {
+
+	return sizeof(long) + 8 * sizeof(double)
+			+ 4 * blocksPerColumn(N) * sizeof(long);
+}
+
+/**
+ * Encodes block number block of the frame into out, behind a mode byte, and
+ * replaces the frame before last by it in the history. Blocks that do not
+ * shrink are stored raw. Returns the bytes written.
+ */
+static size_t encodeBlock(
+		codecState_t* state,
+		const double* frame,
+		const long block,
+		unsigned char* out) {
+
+	const long N = state->N;
+	const int column = block / blocksPerColumn(N);
+	const long start = (block % blocksPerColumn(N)) * CODEC_BLOCK;
+	const int n = N - start < CODEC_BLOCK ? N - start : CODEC_BLOCK;
+	const size_t first = (size_t) column * N + start;
+	const double* values = frame + first;
+	long* older = state->history[state->older] + first;
+
+	unsigned char* bytes = out + 1;
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		const long integer = toInteger(state, values[i], column);
+		const uint64_t error = (uint64_t) integer
+				- (uint64_t) predict(state, first + i);
+		older[i] = integer;
+
+		// Zigzag, so small negative errors take few bytes
+		uint64_t zigzag = (error << 1) ^ (uint64_t) ((int64_t) error >> 63);
+		while (zigzag >= 0x80) {
+			*bytes++ = (unsigned char) (zigzag | 0x80);
+			zigzag >>= 7;
+		}
+		*bytes++ = (unsigned char) zigzag;
+	}
+
+	if (bytes - out > n * sizeof(double)) {
+		out[0] = BLOCK_RAW;
+		memcpy(out + 1, values, n * sizeof(double));
+		return 1 + n * sizeof(double);
+	}
+	out[0] = BLOCK_CODED;
+	return bytes - out;
+}
+
+/**
+ * Decodes block number block from in into the frame and replaces the frame
+ * before last by it in the history. Returns 0 on success, 1 if the block is
+ * malformed.
+ */
+static int decodeBlock(
+		codecState_t* state,
+		const unsigned char* in,
+		const size_t size,
+		const long block,
+		double* frame) {
+
+	const long N = state->N;
+	const int column = block / blocksPerColumn(N);
+	const long start = (block % blocksPerColumn(N)) * CODEC_BLOCK;
+	const int n = N - start < CODEC_BLOCK ? N - start : CODEC_BLOCK;
+	const size_t first = (size_t) column * N + start;
+	double* values = frame + first;
+	long* older = state->history[state->older] + first;
+
+	// Raw block, the encoder took the integers of the exact values
+	unsigned int i;
+	if (in[0] == BLOCK_RAW) {
+		if (size != 1 + n * sizeof(double)) {
+			return 1;
+		}
+		memcpy(values, in + 1, n * sizeof(double));
+		for (i = 0; i < n; i++) {
+			older[i] = toInteger(state, values[i], column);
+		}
+		return 0;
+	}
+
+	const unsigned char* bytes = in + 1;
+	const unsigned char* end = in + size;
+	for (i = 0; i < n; i++) {
+		uint64_t zigzag = 0;
+		int shift = 0;
+		do {
+			if (bytes == end || shift > 63) {
+				return 1;
+			}
+			zigzag |= (uint64_t) (*bytes & 0x7f) << shift;
+			shift += 7;
+		} while (*bytes++ & 0x80);
+
+		const uint64_t error = (zigzag >> 1) ^ -(zigzag & 1);
+		const long integer = (long) (error
+				+ (uint64_t) predict(state, first + i));
+		older[i] = integer;
+
+		if (state->encoding == SNAPSHOT_QUANTIZED) {
+			values[i] = state->origin[column] + integer * state->step[column];
+		} else {
+			memcpy(values + i, &integer, sizeof(double));
+		}
+	}
+
+	return bytes != end;
+}
+
+/**
+ * Returns the integer a value is coded as: the bits of the double, or the
+ * nearest number of quantization steps from the column origin.
+ */
+static long toInteger(const codecState_t* state, const double value,
+		const int column) {
+
+	long integer;
+	if (state->encoding == SNAPSHOT_QUANTIZED) {
+		integer = llround((value - state->origin[column])
+				/ state->step[column]);
+	} else {
+		memcpy(&integer, &value, sizeof(long));
+	}
+
+	return integer;
+}
+
+/**
+ * Predicts integer i of the next frame: nothing in a keyframe, the previous
+ * frame after one, else a straight line through the two previous frames.
+ * Wraps around instead of overflowing.
+ */
+static long predict(const codecState_t* state, const size_t i) {
+
+	const uint64_t previous = state->history[!state->older][i];
+	switch (state->order) {
+		case 0:
+			return 0;
+		case 1:
+			return (long) previous;
+		default:
+			return (long) (2 * previous
+					- (uint64_t) state->history[state->older][i]);
+	}
+}
@@ -0,0 +1,103 @@
+/**
+ *	codec.h
+ *	Contains functions for encoding and decoding trajectory frames
+ *
+ *	A frame holds x, y, v_x and v_y of every particle, N doubles each. Every
+ *	column is cut into blocks of CODEC_BLOCK values that are coded on their
+ *	own, so blocks can be encoded and decoded in parallel.
+ *
+ *	Every value is turned into an integer: the bits of the double, or the
+ *	number of quantization steps from the column origin. Particles move
+ *	smoothly, so the integer is predicted from the two previous frames, and
+ *	the prediction error is stored as a zigzag varint. Keyframes are stored
+ *	without prediction, the frame after one with the previous frame as the
+ *	prediction.
+ *
+ *	Encoded payload: prediction order (long, 0 in keyframes), origin and step
+ *	of each column (2 doubles each), size in bytes of every block (long each),
+ *	then the blocks in order. A block starts with a mode byte, and is stored
+ *	as plain doubles if coding does not make it smaller.
+ */
+
+#pragma once
+#include <stddef.h>
+
+#define SNAPSHOT_MAGIC "GALTRAJ1"
+
+// Frame payload encodings
+#define SNAPSHOT_RAW 0 // Plain doubles
+#define SNAPSHOT_DELTA 1 // Lossless, bits predicted from earlier frames
+#define SNAPSHOT_QUANTIZED 2 // Lossy, quantized to within an error bound
+
+#define CODEC_BLOCK 4096 // Values per independently coded block
+#define CODEC_KEYFRAME 32 // Frames between keyframes
+
+// What a coded frame refers to: the two previous frames
+typedef struct codecState {
+	long N;
+	int encoding;
+	double errorBound; // Largest allowed error with SNAPSHOT_QUANTIZED
+	long* history[2]; // Integers of the two previous frames, 4*N each
+	int older; // history[older] holds the frame before last
+	int order; // Previous frames to predict the next frame from
+	double origin[4]; // Quantization grid of every column
+	double step[4];
+} codecState_t;
+
+/**
+ * Creates the coding state of a trajectory.
+ *
+ * @param N          The total number of particles.
+ * @param encoding   SNAPSHOT_DELTA or SNAPSHOT_QUANTIZED.
+ * @param errorBound Largest error of any value with SNAPSHOT_QUANTIZED.
+ * @return           The state, or NULL on failure.
+ */
+codecState_t* codecCreate(const long N, const int encoding,
+		const double errorBound);
+
+void codecFree(codecState_t* state);
+
+/**
+ * Returns the largest number of bytes an encoded frame can take.
+ */
+size_t codecMaxBytes(const long N);
+
+/**
+ * Encodes a frame of 4*N values into out, using threads threads, and adds
+ * it to the frames the next frame is predicted from.
+ *
+ * @param state    Coding state.
+ * @param frame    x, y, v_x and v_y of every particle.
+ * @param keyframe Encode without reference to earlier frames if 1.
+ * @param out      Buffer of codecMaxBytes(N) bytes.
+ * @param threads  Number of threads.
+ * @return         Bytes written to out, 0 on failure.
+ */
+size_t encodeFrame(
+		codecState_t* __restrict state,
+		const double* __restrict frame,
+		const int keyframe,
+		unsigned char* __restrict out,
+		const int threads);
+
+/**
+ * Decodes a frame encoded by encodeFrame() and adds it to the frames the
+ * next frame is predicted from. Frames must be decoded in order from a
+ * keyframe.
+ *
+ * @param state   Coding state.
+ * @param in      Encoded payload.
+ * @param size    Bytes of payload.
+ * @param frame   Set to x, y, v_x and v_y of every particle.
+ * @return        Returns 0 on success, else 1.
+ */
+int decodeFrame(
+		codecState_t* __restrict state,
+		const unsigned char* __restrict in,
+		const size_t size,
+		double* __restrict frame);
+
+/**
+ * Returns 1 if the encoded payload is a keyframe, else 0.
+ */
+int isKeyframe(const unsigned char* in);
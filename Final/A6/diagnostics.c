@@ -0,0 +1,99 @@
+#include "diagnostics.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+diagnostics_t* diagnosticsOpen(const char* filename, const int interval) {
+
+	diagnostics_t* diagnostics =
+			(diagnostics_t*) calloc(1, sizeof(diagnostics_t));
+	if (!diagnostics) {
+		printf("ERROR: Malloc failure");
+		return NULL;
+	}
+	diagnostics->fp = fopen(filename, "w");
+	if (!diagnostics->fp) {
+		printf("%s\n", "ERROR: Failed to open diagnostics file.");
+		free(diagnostics);
+		return NULL;
+	}
+	diagnostics->interval = interval;
+	fprintf(diagnostics->fp, "step,kinetic,potential,energy,momentum_x,"
+			"momentum_y,angular_momentum,energy_drift,momentum_drift,"
+			"angular_momentum_drift\n");
+
+	return diagnostics;
+}
+
+void diagnosticsCollect(
+		diagnostics_t* __restrict diagnostics,
+		const diagnosticsSums_t* __restrict sums) {
+
+	#pragma omp atomic
+	diagnostics->sums.kinetic += sums->kinetic;
+	#pragma omp atomic
+	diagnostics->sums.potential += sums->potential;
+	#pragma omp atomic
+	diagnostics->sums.p_x += sums->p_x;
+	#pragma omp atomic
+	diagnostics->sums.p_y += sums->p_y;
+	#pragma omp atomic
+	diagnostics->sums.angular += sums->angular;
+	#pragma omp atomic
+	diagnostics->sums.momentumScale += sums->momentumScale;
+}
+
+void diagnosticsWrite(diagnostics_t* diagnostics, const int step) {
+
+	const diagnosticsSums_t* sums = &diagnostics->sums;
+	const double energy = sums->kinetic + sums->potential;
+	if (!diagnostics->measured) {
+		diagnostics->first[0] = energy;
+		diagnostics->first[1] = sums->p_x;
+		diagnostics->first[2] = sums->p_y;
+		diagnostics->first[3] = sums->angular;
+	}
+
+	// Drift relative to the first measurement. Momentum is often near zero,
+	// so its drift is taken relative to the sum of m|v| instead.
+	const double* first = diagnostics->first;
+	const double d_x = sums->p_x - first[1];
+	const double d_y = sums->p_y - first[2];
+	double drift[3];
+	drift[0] = first[0] ? fabs((energy - first[0]) / first[0]) : 0.0;
+	drift[1] = sums->momentumScale ?
+			sqrt(d_x*d_x + d_y*d_y) / sums->momentumScale : 0.0;
+	drift[2] = first[3] ? fabs((sums->angular - first[3]) / first[3]) : 0.0;
+	unsigned int i;
+	for (i = 0; i < 3; i++) {
+		if (drift[i] > diagnostics->largest[i]) {
+			diagnostics->largest[i] = drift[i];
+		}
+	}
+
+	fprintf(diagnostics->fp, "%d,%.15e,%.15e,%.15e,%.15e,%.15e,%.15e,"
+			"%.6e,%.6e,%.6e\n", step, sums->kinetic, sums->potential, energy,
+			sums->p_x, sums->p_y, sums->angular, drift[0], drift[1], drift[2]);
+	diagnostics->measured++;
+
+	// Start the next measurement
+	memset(&diagnostics->sums, 0, sizeof(diagnosticsSums_t));
+}
+
+int diagnosticsClose(diagnostics_t* diagnostics) {
+
+	printf("Diagnostics: %d measurements, largest drift of energy %.3e, "
+			"momentum %.3e, angular momentum %.3e\n", diagnostics->measured,
+			diagnostics->largest[0], diagnostics->largest[1],
+			diagnostics->largest[2]);
+	const int failed = fclose(diagnostics->fp) != 0;
+	if (failed) {
+		printf("%s\n", "ERROR: Failed to write diagnostics file.");
+	}
+	free(diagnostics);
+
+	return failed;
+}
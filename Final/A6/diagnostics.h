@@ -0,0 +1,88 @@
+/**
+ *	diagnostics.h
+ *	Contains conservation diagnostics of the simulation
+ *
+ *	Every interval timesteps the kinetic and potential energy, the linear
+ *	momentum and the angular momentum about the origin are measured on the
+ *	state the quadtree was built from, and written with their drift since
+ *	the first measurement. The potential is summed during the force walk of
+ *	that timestep, with the same quadtree and opening criterion, so a
+ *	measurement costs a few operations per interaction instead of O(N^2).
+ */
+
+#pragma once
+#include <stdio.h>
+#include <math.h>
+#include "modules.h"
+
+// Sums of a measurement, per thread or in total
+typedef struct diagnosticsSums {
+	double kinetic;
+	double potential;
+	double p_x;
+	double p_y;
+	double angular;
+	double momentumScale; // Sum of m|v|, the scale of momentum drift
+} diagnosticsSums_t;
+
+// Diagnostics file and the measurement in progress
+typedef struct diagnostics {
+	FILE* fp;
+	int interval; // Timesteps between measurements
+	int measured; // Measurements written
+	diagnosticsSums_t sums;
+	double first[4]; // Energy, p_x, p_y and angular momentum first measured
+	double largest[3]; // Largest energy, momentum and angular momentum drift
+} diagnostics_t;
+
+/**
+ * Creates the diagnostics file "filename" for a measurement every interval
+ * timesteps.
+ *
+ * @return The diagnostics, or NULL on failure.
+ */
+diagnostics_t* diagnosticsOpen(const char* filename, const int interval);
+
+/**
+ * Adds a particle to the sums of the calling thread, before it is updated.
+ *
+ * @param phi Potential per unit mass at the particle, without G.
+ */
+static inline void diagnosticsAdd(
+		diagnosticsSums_t* __restrict sums,
+		const double x,
+		const double y,
+		const double v_x,
+		const double v_y,
+		const double mass,
+		const double G,
+		const double phi) {
+
+	// Every pair is counted from both ends, hence the half
+	sums->potential += 0.5 * G * mass * phi;
+	sums->kinetic += 0.5 * mass * (v_x*v_x + v_y*v_y);
+	sums->p_x += mass * v_x;
+	sums->p_y += mass * v_y;
+	sums->angular += mass * (x * v_y - y * v_x);
+	sums->momentumScale += mass * sqrt(v_x*v_x + v_y*v_y);
+}
+
+/**
+ * Adds the sums of the calling thread to the measurement in progress.
+ */
+void diagnosticsCollect(
+		diagnostics_t* __restrict diagnostics,
+		const diagnosticsSums_t* __restrict sums);
+
+/**
+ * Writes the measurement of timestep step with its drift, and starts the
+ * next one. Called by one thread after every thread has collected.
+ */
+void diagnosticsWrite(diagnostics_t* diagnostics, const int step);
+
+/**
+ * Prints the largest drift, closes the file and frees the diagnostics.
+ *
+ * @return Returns 0 on success, else 1.
+ */
+int diagnosticsClose(diagnostics_t* diagnostics);
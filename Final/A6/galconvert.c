@@ -0,0 +1,177 @@
+// RUN BY:
+// ./galconvert ../input_data/ellipse_N_05000.gal ellipse_N_05000.gal2
+// ./galconvert ellipse_N_05000.gal2 ellipse_N_05000.gal
+// ./galconvert trajectory.galt frame.gal --frame 10
+//
+// Galaxy v2 input files are written as .gal files. Trajectories written by
+// galsim --snapshot are decoded and frame k (--frame k, the last frame by
+// default) is written as a .gal file. Any other input file is read as a .gal
+// file, with N taken from its size, and written as galaxy v2.
+
+/**
+ * Converts between .gal and galaxy v2 files, and extracts trajectory frames.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "modules.h"
+#include "io.h"
+#include "codec.h"
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static int extractFrame(
+		const char* inputFilename,
+		const char* outputFilename,
+		int frame);
+
+/*******************************************************************************
+  FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Main function
+ *
+ */
+int main(int argc, char const *argv[]) {
+
+	// Check proper number of input arguments
+	int frame = -1;
+	if (argc == 5 && !strcmp(argv[3], "--frame")) {
+		frame = atoi(argv[4]);
+	} else if (argc != 3) {
+		printf("%s\n", "Input error: Expected input and output filename");
+		return 1;
+	}
+	const char* inputFilename = argv[1];
+	const char* outputFilename = argv[2];
+
+	// Trajectory frame to .gal
+	FILE* fp = fopen(inputFilename, "rb");
+	char magic[8] = { 0 };
+	if (fp) {
+		const size_t read = fread(magic, 1, 8, fp);
+		fclose(fp);
+		if (read == 8 && !memcmp(magic, SNAPSHOT_MAGIC, 8)) {
+			return extractFrame(inputFilename, outputFilename, frame);
+		}
+	}
+	if (frame >= 0) {
+		printf("%s\n", "Input error: --frame needs a trajectory file");
+		return 1;
+	}
+
+	particles_t particles;
+	double* brightness;
+
+	// Galaxy v2 to .gal, straight from the mapped columns
+	if (isGalaxyFile(inputFilename)) {
+		galaxyMap_t map;
+		if (mapGalaxy(&particles, &brightness, &map, inputFilename))
+			return 1;
+		const long N = ((galaxyHeader_t*) map.data)->N;
+		const int failed = writeOutput(&particles, brightness, N,
+				outputFilename);
+		unmapGalaxy(&map);
+		return failed;
+	}
+
+	// .gal to galaxy v2, N from the file size
+	struct stat fileStat;
+	if (stat(inputFilename, &fileStat)) {
+		printf("%s\n", "ERROR: Failed to open input file. Is it in directory?");
+		return 1;
+	}
+	if (fileStat.st_size % (6 * sizeof(double))) {
+		printf("%s\n", "ERROR: Input file size is not a whole number of records.");
+		return 1;
+	}
+	const long N = fileStat.st_size / (6 * sizeof(double));
+	particles.x = (double*) malloc(N * sizeof(double));
+	particles.y = (double*) malloc(N * sizeof(double));
+	particles.v_x = (double*) malloc(N * sizeof(double));
+	particles.v_y = (double*) malloc(N * sizeof(double));
+	particles.mass = (double*) malloc(N * sizeof(double));
+	brightness = (double*) malloc(N * sizeof(double));
+	if (!(particles.x && particles.y && particles.v_x && particles.v_y
+				&& particles.mass && brightness)) {
+		printf("ERROR: Malloc failure");
+		return 1;
+	}
+
+	galaxyHeader_t header = { .N = N };
+	const int failed = readData(&particles, brightness, inputFilename, N)
+			|| writeGalaxy(&particles, brightness, &header, outputFilename);
+
+	free(particles.x);
+	free(particles.y);
+	free(particles.v_x);
+	free(particles.v_y);
+	free(particles.mass);
+	free(brightness);
+
+	return failed;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Decodes frame number frame of trajectory inputFilename, the last frame if
+ * negative, and writes it as .gal file outputFilename.
+ * Returns 0 on success, else 1.
+ */
+static int extractFrame(
+		const char* inputFilename,
+		const char* outputFilename,
+		int frame) {
+
+	// N and the number of frames from the header
+	long header[4];
+	FILE* fp = fopen(inputFilename, "rb");
+	if (!fp || fread(header, sizeof(header), 1, fp) != 1) {
+		printf("%s\n", "ERROR: Failed to read trajectory header.");
+		if (fp) {
+			fclose(fp);
+		}
+		return 1;
+	}
+	fclose(fp);
+	const long N = header[1];
+	if (frame < 0) {
+		frame = (int) header[2] - 1;
+	}
+
+	particles_t particles;
+	particles.x = (double*) malloc(N * sizeof(double));
+	particles.y = (double*) malloc(N * sizeof(double));
+	particles.v_x = (double*) malloc(N * sizeof(double));
+	particles.v_y = (double*) malloc(N * sizeof(double));
+	particles.mass = (double*) malloc(N * sizeof(double));
+	double* brightness = (double*) malloc(N * sizeof(double));
+	if (!(particles.x && particles.y && particles.v_x && particles.v_y
+				&& particles.mass && brightness)) {
+		printf("ERROR: Malloc failure");
+		return 1;
+	}
+
+	int step;
+	const int failed = readTrajectoryFrame(&particles, brightness, N, frame,
+				&step, inputFilename)
+			|| writeOutput(&particles, brightness, N, outputFilename);
+	if (!failed) {
+		printf("Frame %d of %ld frames: step %d\n", frame, header[2], step);
+	}
+
+	free(particles.x);
+	free(particles.y);
+	free(particles.v_x);
+	free(particles.v_y);
+	free(particles.mass);
+	free(brightness);
+
+	return failed;
+}
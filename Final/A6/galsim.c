@@ -1,4 +1,11 @@
 #include "galsim.h"
+#include "numa.h"
+#include "io.h"
+#include "capture.h"
+#include "memory.h"
+#include "timing.h"
+#include "stats.h"
+#include "trace.h"
 #include <time.h>
 
 #define GRAPHICS_FPS 30
@@ -10,22 +17,73 @@
 static void updateParticles(
 		node_t* __restrict root,
 		particles_t* __restrict particles,
-		simulationConstants_t* __restrict simulationConstants);
+		simulationConstants_t* __restrict simulationConstants,
+		unsigned int* __restrict interactions,
+		const long* __restrict zoneStart,
+		diagnosticsSums_t* __restrict sums);
 
-static void calculateForces(
-		double x,
-		double y,
-		node_t* __restrict node,
+static void updateTiles(
+		node_t* __restrict root,
+		particleTile_t* __restrict tiles,
+		simulationConstants_t* __restrict simulationConstants,
+		unsigned int* __restrict interactions,
+		const long* __restrict zoneStart,
+		diagnosticsSums_t* __restrict sums);
+
+static node_t* localQuadtree(
+		node_t* __restrict root,
+		node_t* __restrict replicas,
+		const int* __restrict socketOfThread);
+
+static void freeQuadtrees(
+		node_t* __restrict root,
+		nodePool_t* __restrict pool,
+		node_t* __restrict replicas,
+		const int n_sockets);
+
+static inline void updateParticle(
+		const long i,
+		node_t* __restrict root,
+		particles_t* __restrict particles,
 		const double G,
 		const double eps0,
 		const double delta_t,
 		const double theta_max,
-		double* __restrict a_x,
-		double* __restrict a_y);
+		unsigned int* __restrict interactions,
+		diagnosticsSums_t* __restrict sums);
+
+static inline void updateTile(
+		const long t,
+		node_t* __restrict root,
+		particleTile_t* __restrict tiles,
+		const long N,
+		const double G,
+		const double eps0,
+		const double delta_t,
+		const double theta_max,
+		unsigned int* __restrict interactions,
+		diagnosticsSums_t* __restrict sums);
+
+static void toTiles(
+		const particles_t* __restrict particles,
+		particleTile_t* __restrict tiles,
+		const long N);
+
+static void fromTiles(
+		const particleTile_t* __restrict tiles,
+		particles_t* __restrict particles,
+		const long N);
+
+static void captureState(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const unsigned int* __restrict interactions,
+		simulationConstants_t* __restrict simulationConstants,
+		const int step);
 
 static void showGraphics(
 		particles_t* __restrict particles,
-		const int N,
+		const long N,
 		graphicsConstants_t* __restrict graphicsConstants);
 
 /* Debug funcs
@@ -42,30 +100,255 @@ static void showGraphics(
 // Simulate the movement of the particles
 void simulate(
 		particles_t* __restrict particles,
-		simulationConstants_t* __restrict simulationConstants) {
+		double* __restrict brightness,
+		simulationConstants_t* __restrict simulationConstants,
+		snapshotWriter_t* __restrict snapshots,
+		timing_t* __restrict timing,
+		diagnostics_t* __restrict diagnostics) {
+
+	// Extract simulation constants
+	const long N = *simulationConstants->N;
+	const int n_threads = *simulationConstants->n_threads;
 
 	// Set number of threads
 	#ifdef _OPENMP
-	omp_set_num_threads(*simulationConstants->n_threads);
+	omp_set_num_threads(n_threads);
 	#endif
 
-	// Create root
+	// Create root, and the pool its nodes are taken from. A pool that fails
+	// to allocate hands out malloc'd nodes instead.
 	node_t root;
+	nodePool_t pool;
+	createNodePool(&pool, N, *simulationConstants->hugePages);
+
+	// Interactions per particle during the last step, one each to begin with
+	unsigned int* interactions =
+			(unsigned int*) malloc(N * sizeof(unsigned int));
+	long* zoneStart = (long*) malloc((n_threads + 1) * sizeof(long));
+	long i;
+	for (i = 0; i < N; i++) {
+		interactions[i] = 1;
+	}
 
-	// Simulate
-	unsigned int i;
-	for (i = 0; i < *simulationConstants->nsteps; i++) {
+	// Sockets of the (pinned) threads, if the quadtree is replicated per socket
+	int* socketOfThread = NULL;
+	node_t* replicas = NULL;
+	int n_sockets = 1;
+	if (*simulationConstants->replicateTree) {
+		socketOfThread = (int*) malloc(n_threads * sizeof(int));
+		n_sockets = findThreadSockets(n_threads, socketOfThread);
+		replicas = (node_t*) malloc(n_sockets * sizeof(node_t));
+	}
 
-		// Build quadtree
-		buildQuadtree(particles, *simulationConstants->N, &root);
+	#ifdef TREE_STATS
+	statsBegin(n_threads);
+	#endif
 
-		// Update particles
-		updateParticles(&root, particles, simulationConstants);
+	// Tiled copy of the particles to simulate on, with LAYOUT_TILED
+	const long n_tiles = (N + TILE - 1) / TILE;
+	particleTile_t* tiles = NULL;
+	if (*simulationConstants->layout == LAYOUT_TILED) {
+		tiles = (particleTile_t*) allocateHuge(
+				n_tiles * sizeof(particleTile_t),
+				*simulationConstants->hugePages);
+		if (tiles) {
+			toTiles(particles, tiles, N);
+		} else {
+			printf("%s\n", "WARNING: Out of memory for tiles, using SoA layout");
+		}
+	}
 
-		// Free quadtree
-		freeQuadtree(&root);
+	// Simulate, with the same team of threads for all timesteps between
+	// two checkpoints
+	const int nsteps = *simulationConstants->nsteps;
+	const int checkpointInterval = *simulationConstants->checkpointInterval;
+	int firstStep = *simulationConstants->firstStep;
+	const int captureStep = *simulationConstants->captureStep;
+	int treeBuilt = 0;
+	double* frame = NULL;
+	while (firstStep < nsteps) {
+
+		// Capture the state the next quadtree is built from
+		if (firstStep == captureStep) {
+			if (tiles) {
+				fromTiles(tiles, particles, N);
+			}
+			captureState(particles, brightness, interactions,
+					simulationConstants, firstStep);
+		}
+
+		// Steps until the next checkpoint, or the capture
+		int lastStep = nsteps;
+		if (checkpointInterval > 0 &&
+				(firstStep / checkpointInterval + 1) * checkpointInterval
+				< nsteps) {
+			lastStep = (firstStep / checkpointInterval + 1) * checkpointInterval;
+		}
+		if (captureStep > firstStep && captureStep < lastStep) {
+			lastStep = captureStep;
+		}
+
+		#pragma omp parallel
+		{
+			#ifdef _OPENMP
+			const int thread = omp_get_thread_num();
+			#else
+			const int thread = 0;
+			#endif
+			unsigned int step;
+			for (step = firstStep; step < lastStep; step++) {
+
+				// One thread replaces the quadtree while the others wait
+				#pragma omp single nowait
+				{
+					// Free last step's quadtree
+					timingMark_t mark;
+					if (treeBuilt) {
+						traceBegin(thread, "free");
+						timingStart(timing, thread, &mark);
+						freeQuadtrees(&root, &pool, replicas, n_sockets);
+						timingStop(timing, step - 1, thread, PHASE_FREE, &mark);
+						traceEnd(thread, "free");
+					}
+					traceBegin(thread, "build");
+					timingStart(timing, thread, &mark);
+
+					// Build quadtree
+					if (tiles) {
+						buildQuadtreeTiled(tiles, N, &root, &pool);
+					} else {
+						buildQuadtree(particles, N, &root, &pool);
+					}
+					treeBuilt = 1;
+					timingStop(timing, step, thread, PHASE_BUILD, &mark);
+
+					// Split work between threads using last step's cost
+					computeCostZones(interactions, N, n_threads, zoneStart);
+					traceEnd(thread, "build");
+				}
+				traceBegin(thread, "wait");
+				#pragma omp barrier
+				traceEnd(thread, "wait");
+
+				// Update particles, walking the tree of this thread's socket
+				node_t* local = localQuadtree(&root, replicas, socketOfThread);
+
+				// Conservation diagnostics of the state the tree was built
+				// from are summed during the walk
+				diagnosticsSums_t sums = { 0.0 };
+				const int measure = diagnostics
+						&& step % diagnostics->interval == 0;
+
+				timingMark_t mark;
+				traceBegin(thread, "force");
+				timingStart(timing, thread, &mark);
+				if (tiles) {
+					updateTiles(local, tiles, simulationConstants,
+							interactions, zoneStart, measure ? &sums : NULL);
+				} else {
+					updateParticles(local, particles, simulationConstants,
+							interactions, zoneStart, measure ? &sums : NULL);
+				}
+				timingStop(timing, step, thread, PHASE_FORCE, &mark);
+				if (measure) {
+					diagnosticsCollect(diagnostics, &sums);
+				}
+				traceEnd(thread, "force");
+
+				// Every particle must be updated before the next tree is built
+				traceBegin(thread, "wait");
+				#pragma omp barrier
+				traceEnd(thread, "wait");
+
+				if (measure) {
+					#pragma omp single nowait
+					diagnosticsWrite(diagnostics, step);
+				}
+
+				// Copy the state into a free buffer of the snapshot writer
+				if (snapshots && (step + 1) % snapshots->interval == 0) {
+					traceBegin(thread, "snapshot");
+					#pragma omp single
+					frame = snapshotAcquire(snapshots);
+
+					if (tiles) {
+						#pragma omp for schedule(static)
+						for (i = 0; i < N; i++) {
+							const particleTile_t* tile = tiles + i / TILE;
+							frame[i] = tile->x[i % TILE];
+							frame[N + i] = tile->y[i % TILE];
+							frame[2*N + i] = tile->v_x[i % TILE];
+							frame[3*N + i] = tile->v_y[i % TILE];
+						}
+					} else {
+						#pragma omp for schedule(static)
+						for (i = 0; i < N; i++) {
+							frame[i] = particles->x[i];
+							frame[N + i] = particles->y[i];
+							frame[2*N + i] = particles->v_x[i];
+							frame[3*N + i] = particles->v_y[i];
+						}
+					}
+
+					#pragma omp single nowait
+					snapshotSubmit(snapshots, step + 1);
+					traceEnd(thread, "snapshot");
+				}
+			}
+
+			#ifdef TREE_STATS
+			collectTraversal(thread);
+			#endif
+		}
+
+		// Checkpoint, using all threads to write
+		firstStep = lastStep;
+		if (firstStep < nsteps && checkpointInterval > 0
+				&& firstStep % checkpointInterval == 0) {
+			if (tiles) {
+				fromTiles(tiles, particles, N);
+			}
+			traceBegin(0, "checkpoint");
+			const long trajectoryEnd = snapshots ? snapshotSync(snapshots) : 0;
+			writeCheckpoint(particles, brightness, simulationConstants,
+					firstStep, trajectoryEnd,
+					*simulationConstants->checkpointFilename);
+			traceEnd(0, "checkpoint");
+		}
+	}
+
+	// Huge page backing of the last quadtree
+	if (*simulationConstants->memoryReport) {
+		printf("Memory: nodes %.1f of %.1f MB in huge pages\n",
+				hugePageBytes(pool.nodes, pool.used * sizeof(node_t)) / 1e6,
+				pool.used * sizeof(node_t) / 1e6);
+	}
+
+	// Free quadtree
+	if (treeBuilt) {
+		timingMark_t mark;
+		traceBegin(0, "free");
+		timingStart(timing, 0, &mark);
+		freeQuadtrees(&root, &pool, replicas, n_sockets);
+		timingStop(timing, nsteps - 1, 0, PHASE_FREE, &mark);
+		traceEnd(0, "free");
+	}
+	freeNodePool(&pool);
+
+	#ifdef TREE_STATS
+	statsReport();
+	#endif
+
+	// Back to the caller's layout
+	if (tiles) {
+		fromTiles(tiles, particles, N);
+		freeHuge(tiles, n_tiles * sizeof(particleTile_t));
 	}
 
+	free(interactions);
+	free(zoneStart);
+	free(socketOfThread);
+	free(replicas);
 }
 
 
@@ -83,23 +366,44 @@ void simulateWithGraphics(
 	InitializeGraphics((char*) program, windowSize, windowSize);
 	SetCAxes(0,1);	// Color axis (so 0 = white, 1 = black)
 
-	// Create root
+	// Extract simulation constants
+	const long N = *simulationConstants->N;
+	const int n_threads = *simulationConstants->n_threads;
+
+	// Create root, and the pool its nodes are taken from
 	node_t root;
+	nodePool_t pool;
+	createNodePool(&pool, N, *simulationConstants->hugePages);
+
+	// Interactions per particle during the last step, one each to begin with
+	unsigned int* interactions =
+			(unsigned int*) malloc(N * sizeof(unsigned int));
+	long* zoneStart = (long*) malloc((n_threads + 1) * sizeof(long));
+	long i;
+	for (i = 0; i < N; i++) {
+		interactions[i] = 1;
+	}
 
 	// Simulate
-	unsigned int i;
 	double loopTimer;
 	for (i = 0; i < *simulationConstants->nsteps; i++) {
 		clock_t timeBefore = clock();	// for fps
 
 		// Build quadtree
-		buildQuadtree(particles, *simulationConstants->N, &root);
+		buildQuadtree(particles, N, &root, &pool);
+
+		// Split work between threads using last step's cost
+		computeCostZones(interactions, N, n_threads, zoneStart);
 
 		// Update particles
-		updateParticles(&root, particles, simulationConstants);
+		#pragma omp parallel
+		{
+			updateParticles(&root, particles, simulationConstants,
+					interactions, zoneStart, NULL);
+		}
 
 		// Free quadtree
-		freeQuadtree(&root);
+		releaseQuadtree(&root, &pool);
 
 		// Variable fps
 		loopTimer = (double) (clock() - timeBefore)/CLOCKS_PER_SEC;	//Time in seconds
@@ -112,6 +416,10 @@ void simulateWithGraphics(
 
 	}
 
+	freeNodePool(&pool);
+	free(interactions);
+	free(zoneStart);
+
 	// Remove graphics handles
 	FlushDisplay();
 	CloseDisplay();
@@ -122,96 +430,340 @@ void simulateWithGraphics(
   STATIC FUNCTION DEFINITIONS
  *******************************************************************************/
 
+// Updates this thread's share of the particles. Called by every thread of
+// the team, does not wait for the other threads when done. Adds the
+// particles to the diagnostics sums of this thread, if not NULL.
 static void updateParticles(
 		node_t* __restrict root,
 		particles_t* __restrict particles,
-		simulationConstants_t* __restrict simulationConstants) {
+		simulationConstants_t* __restrict simulationConstants,
+		unsigned int* __restrict interactions,
+		const long* __restrict zoneStart,
+		diagnosticsSums_t* __restrict sums) {
 
 	// Get some constants on stack for speedup
 	const double G = *(simulationConstants->G);
 	const double eps0 = *(simulationConstants->eps0);
 	const double delta_t = *(simulationConstants->delta_t);
 	const double theta_max = *(simulationConstants->theta_max);
-	const int N = *(simulationConstants->N);
+	const long N = *(simulationConstants->N);
+	const int n_threads = *(simulationConstants->n_threads);
+	const schedule_t schedule = *(simulationConstants->schedule);
+	const int chunkSize = *(simulationConstants->chunkSize);
 
 	// Loop particles
-	unsigned int i;
-	#pragma omp parallel
-	{
-		#pragma omp for schedule(auto)
-			for (i = 0; i < N; i++) {
-
-				// Set acceleration to zero
-				double a_x = 0.0;
-				double a_y = 0.0;
-				const double x = particles->x[i];
-				const double y = particles->y[i];
-
-				// Update acceleration
-				calculateForces(
-						x, y,
-						root,
-						G, eps0, delta_t, theta_max,
-						&a_x, &a_y);
-
-				// Update velocity
-				particles->v_x[i] += -G * delta_t * a_x;
-				particles->v_y[i] += -G * delta_t * a_y;
-
-				// Update position
-				particles->x[i] += delta_t * particles->v_x[i];
-				particles->y[i] += delta_t * particles->v_y[i];
+	long i;
+	if (schedule == SCHEDULE_DYNAMIC) {
+		// Threads claim chunks of particles as they finish
+		#pragma omp for schedule(dynamic, chunkSize) nowait
+		for (i = 0; i < N; i++) {
+			updateParticle(i, root, particles,
+					G, eps0, delta_t, theta_max, interactions, sums);
+		}
+	} else if (schedule == SCHEDULE_STATIC) {
+		#pragma omp for schedule(static) nowait
+		for (i = 0; i < N; i++) {
+			updateParticle(i, root, particles,
+					G, eps0, delta_t, theta_max, interactions, sums);
+		}
+	} else {
+		// Each thread takes its own zones of equal cost
+		#ifdef _OPENMP
+		const int thread = omp_get_thread_num();
+		const int threadCount = omp_get_num_threads();
+		#else
+		const int thread = 0;
+		const int threadCount = 1;
+		#endif
+		unsigned int zone;
+		for (zone = thread; zone < n_threads; zone += threadCount) {
+			for (i = zoneStart[zone]; i < zoneStart[zone + 1]; i++) {
+				updateParticle(i, root, particles,
+						G, eps0, delta_t, theta_max, interactions, sums);
+			}
+		}
+	}
+}
+
+// Updates this thread's share of the tiles, like updateParticles(). Zones
+// are rounded to whole tiles.
+static void updateTiles(
+		node_t* __restrict root,
+		particleTile_t* __restrict tiles,
+		simulationConstants_t* __restrict simulationConstants,
+		unsigned int* __restrict interactions,
+		const long* __restrict zoneStart,
+		diagnosticsSums_t* __restrict sums) {
+
+	// Get some constants on stack for speedup
+	const double G = *(simulationConstants->G);
+	const double eps0 = *(simulationConstants->eps0);
+	const double delta_t = *(simulationConstants->delta_t);
+	const double theta_max = *(simulationConstants->theta_max);
+	const long N = *(simulationConstants->N);
+	const int n_threads = *(simulationConstants->n_threads);
+	const schedule_t schedule = *(simulationConstants->schedule);
+	const int chunkSize = *(simulationConstants->chunkSize);
+	const long n_tiles = (N + TILE - 1) / TILE;
+	const int chunkTiles = chunkSize > TILE ? chunkSize / TILE : 1;
+
+	// Loop tiles
+	long t;
+	if (schedule == SCHEDULE_DYNAMIC) {
+		#pragma omp for schedule(dynamic, chunkTiles) nowait
+		for (t = 0; t < n_tiles; t++) {
+			updateTile(t, root, tiles, N,
+					G, eps0, delta_t, theta_max, interactions, sums);
+		}
+	} else if (schedule == SCHEDULE_STATIC) {
+		#pragma omp for schedule(static) nowait
+		for (t = 0; t < n_tiles; t++) {
+			updateTile(t, root, tiles, N,
+					G, eps0, delta_t, theta_max, interactions, sums);
+		}
+	} else {
+		#ifdef _OPENMP
+		const int thread = omp_get_thread_num();
+		const int threadCount = omp_get_num_threads();
+		#else
+		const int thread = 0;
+		const int threadCount = 1;
+		#endif
+		unsigned int zone;
+		for (zone = thread; zone < n_threads; zone += threadCount) {
+			const long first = zoneStart[zone] / TILE;
+			const long last = zoneStart[zone + 1] == N ?
+					n_tiles : zoneStart[zone + 1] / TILE;
+			for (t = first; t < last; t++) {
+				updateTile(t, root, tiles, N,
+						G, eps0, delta_t, theta_max, interactions, sums);
 			}
+		}
 	}
 }
 
-// Calculates force exerted on every particle, recursively
-static void calculateForces(
-		const double x,
-		const double y,
-		node_t* __restrict node,
+// Returns the quadtree this thread should walk. Socket 0 reads the original
+// tree, the first thread of every other socket makes a local copy for its
+// socket. Called by every thread of the team.
+static node_t* localQuadtree(
+		node_t* __restrict root,
+		node_t* __restrict replicas,
+		const int* __restrict socketOfThread) {
+
+	// Not replicated
+	if (!socketOfThread) {
+		return root;
+	}
+
+	#ifdef _OPENMP
+	const int thread = omp_get_thread_num();
+	#else
+	const int thread = 0;
+	#endif
+	const int socket = socketOfThread[thread];
+
+	// Copy if first thread of its socket
+	unsigned int j;
+	for (j = 0; j < thread && socketOfThread[j] != socket; j++);
+	if (socket && j == thread) {
+		copyQuadtree(root, replicas + socket);
+	}
+
+	// Wait for all copies
+	#pragma omp barrier
+
+	return socket ? replicas + socket : root;
+}
+
+// Frees the quadtree and its socket copies, if any
+static void freeQuadtrees(
+		node_t* __restrict root,
+		nodePool_t* __restrict pool,
+		node_t* __restrict replicas,
+		const int n_sockets) {
+
+	releaseQuadtree(root, pool);
+	if (replicas) {
+		unsigned int i;
+		for (i = 1; i < n_sockets; i++) {
+			freeQuadtree(replicas + i);
+		}
+	}
+}
+
+// Updates acceleration, velocity and position of particle i
+static inline void updateParticle(
+		const long i,
+		node_t* __restrict root,
+		particles_t* __restrict particles,
 		const double G,
 		const double eps0,
 		const double delta_t,
 		const double theta_max,
-		double* __restrict a_x,
-		double* __restrict a_y) {
-
-	// Get distance particle<->box
-	double r_x = x - node->xCenterOfMass;
-	double r_y = y - node->yCenterOfMass;
-	double r = sqrt(r_x*r_x + r_y*r_y);
-
-	// Check if box has children, then theta
-	if (node->children &&
-			(node->sideHalf + node->sideHalf) > theta_max * r)  {
-		// Travel branch
-		unsigned int i;
-		for(i = 0; i < 4; i++) {
+		unsigned int* __restrict interactions,
+		diagnosticsSums_t* __restrict sums) {
+
+	// Set acceleration to zero
+	double a_x = 0.0;
+	double a_y = 0.0;
+	const double x = particles->x[i];
+	const double y = particles->y[i];
+
+	// Update acceleration, and the diagnostics before the update
+	interactions[i] = 0;
+	if (sums) {
+		double phi = 0.0;
+		calculateForcesAndPotential(
+				x, y,
+				root,
+				G, eps0, delta_t, theta_max,
+				&a_x, &a_y, &phi, &interactions[i]);
+		diagnosticsAdd(sums, x, y, particles->v_x[i], particles->v_y[i],
+				particles->mass[i], G, phi);
+	} else {
+		calculateForces(
+				x, y,
+				root,
+				G, eps0, delta_t, theta_max,
+				&a_x, &a_y, &interactions[i]);
+	}
+	#ifdef TREE_STATS
+	countWalk(interactions[i]);
+	#endif
+
+	// Update velocity
+	particles->v_x[i] += -G * delta_t * a_x;
+	particles->v_y[i] += -G * delta_t * a_y;
+
+	// Update position
+	particles->x[i] += delta_t * particles->v_x[i];
+	particles->y[i] += delta_t * particles->v_y[i];
+}
+
+// Updates acceleration, velocity and position of the particles of tile t.
+// The tree walk is per particle, the update is on the whole tile at once.
+static inline void updateTile(
+		const long t,
+		node_t* __restrict root,
+		particleTile_t* __restrict tiles,
+		const long N,
+		const double G,
+		const double eps0,
+		const double delta_t,
+		const double theta_max,
+		unsigned int* __restrict interactions,
+		diagnosticsSums_t* __restrict sums) {
+
+	particleTile_t* tile = tiles + t;
+	const long first = t * TILE;
+	const int n = N - first < TILE ? N - first : TILE;
+
+	// Update acceleration, padding particles have none
+	double a_x[TILE] __attribute__((aligned(64))) = { 0.0 };
+	double a_y[TILE] __attribute__((aligned(64))) = { 0.0 };
+	unsigned int j;
+	for (j = 0; j < n; j++) {
+		interactions[first + j] = 0;
+		if (sums) {
+			double phi = 0.0;
+			calculateForcesAndPotential(
+					tile->x[j], tile->y[j],
+					root,
+					G, eps0, delta_t, theta_max,
+					a_x + j, a_y + j, &phi, interactions + first + j);
+			diagnosticsAdd(sums, tile->x[j], tile->y[j], tile->v_x[j],
+					tile->v_y[j], tile->mass[j], G, phi);
+		} else {
 			calculateForces(
-					x, y,
-					node->children + i,
+					tile->x[j], tile->y[j],
+					root,
 					G, eps0, delta_t, theta_max,
-					a_x, a_y);
+					a_x + j, a_y + j, interactions + first + j);
 		}
-	} else {
-		// Calculate denominator
-		double denom = r + eps0;
-		denom = 1/(denom*denom*denom);
-		// Acceleration
-		*a_x += node->mass * r_x * denom;
-		*a_y += node->mass * r_y * denom;
+		#ifdef TREE_STATS
+		countWalk(interactions[first + j]);
+		#endif
+	}
+
+	// Update velocity and position
+	#pragma omp simd
+	for (j = 0; j < TILE; j++) {
+		tile->v_x[j] += -G * delta_t * a_x[j];
+		tile->v_y[j] += -G * delta_t * a_y[j];
+		tile->x[j] += delta_t * tile->v_x[j];
+		tile->y[j] += delta_t * tile->v_y[j];
+	}
+}
+
+// Copies the particles into tiles, from the threads that update them
+static void toTiles(
+		const particles_t* __restrict particles,
+		particleTile_t* __restrict tiles,
+		const long N) {
+
+	long i;
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < N; i++) {
+		particleTile_t* tile = tiles + i / TILE;
+		tile->x[i % TILE] = particles->x[i];
+		tile->y[i % TILE] = particles->y[i];
+		tile->v_x[i % TILE] = particles->v_x[i];
+		tile->v_y[i % TILE] = particles->v_y[i];
+		tile->mass[i % TILE] = particles->mass[i];
+	}
+}
+
+// Copies the particles back from tiles
+static void fromTiles(
+		const particleTile_t* __restrict tiles,
+		particles_t* __restrict particles,
+		const long N) {
+
+	long i;
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < N; i++) {
+		const particleTile_t* tile = tiles + i / TILE;
+		particles->x[i] = tile->x[i % TILE];
+		particles->y[i] = tile->y[i % TILE];
+		particles->v_x[i] = tile->v_x[i % TILE];
+		particles->v_y[i] = tile->v_y[i % TILE];
+		particles->mass[i] = tile->mass[i % TILE];
+	}
+}
+
+// Write the state of timestep step, with a quadtree built on the side
+static void captureState(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const unsigned int* __restrict interactions,
+		simulationConstants_t* __restrict simulationConstants,
+		const int step) {
+
+	const long N = *simulationConstants->N;
+	node_t root;
+	if (*simulationConstants->captureTree) {
+		buildQuadtree(particles, N, &root, NULL);
+	}
+	if (!writeCapture(particles, brightness, interactions,
+				*simulationConstants->captureTree ? &root : NULL,
+				simulationConstants, step,
+				*simulationConstants->captureFilename)) {
+		printf("Capture: step %d written to %s\n", step,
+				*simulationConstants->captureFilename);
+	}
+	if (*simulationConstants->captureTree) {
+		freeQuadtree(&root);
 	}
 }
 
 // Show particles graphically
 static void showGraphics(
 		particles_t* __restrict particles,
-		const int N,
+		const long N,
 		graphicsConstants_t* __restrict graphicsConstants) {
 
 	ClearScreen();
-	unsigned int i;
+	long i;
 	for(i = 0; i < N; i++) {
 		DrawCircle(particles->x[i], particles->y[i], 1, 1,
 				*(graphicsConstants->circleRadius), *(graphicsConstants->circleColour));
@@ -10,6 +10,9 @@
 #include <math.h>
 #include "quadtree.h"
 #include <omp.h>
+#include "snapshot.h"
+#include "timing.h"
+#include "diagnostics.h"
 
 /**
  * Simulates the movement of all the particles in particle_t* particles array.
@@ -18,15 +21,30 @@
  * with timestep delta_t.
  *
  * @param particles Information about every particle.
+ * @param brightness Brightness of every particle, for checkpoints and captures.
  * @param N         The total number of particles.
  * @param G         The Newton gravitational constant G.
  * @param eps0      Plummer spheres constant to smoothe calculations.
  * @param nsteps    Number of timesteps to simulate.
  * @param delta_t   Timestep [seconds].
+ * @param snapshots Writer to hand a frame every snapshots->interval steps,
+ *                  or NULL for no snapshots.
+ * @param timing    Timing to add the phases of every timestep to, or NULL.
+ * @param diagnostics Conservation diagnostics to measure every
+ *                  diagnostics->interval steps, or NULL for none.
+ *
+ * The simulation starts at timestep firstStep. Every checkpointInterval
+ * steps (if nonzero) a checkpoint is written to checkpointFilename. The
+ * state timestep captureStep starts from (if not -1) is written to
+ * captureFilename, see capture.h.
  */
 void simulate(
 		particles_t* __restrict particles,
-		simulationConstants_t* __restrict simulationConstants);
+		double* __restrict brightness,
+		simulationConstants_t* __restrict simulationConstants,
+		snapshotWriter_t* __restrict snapshots,
+		timing_t* __restrict timing,
+		diagnostics_t* __restrict diagnostics);
 
 // Simulate the movement of the particles and show graphically
 void simulateWithGraphics(
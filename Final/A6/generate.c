@@ -0,0 +1,202 @@
+#include "generate.h"
+#include <stdint.h>
+#include <math.h>
+
+#define MEAN_MASS 1.0 // Masses are uniform in [0.5, 1.5]
+#define DISK_RADIUS 0.25 // Radius of uniform disks
+#define PLUMMER_RADIUS 0.05 // Plummer scale length
+#define DISK_SCALE 0.05 // Scale length of exponential disks
+#define ORBIT_RADIUS 0.25 // Distance of colliding galaxies from the centre
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static uint64_t mix(uint64_t z);
+
+static double uniform(
+		const unsigned long seed,
+		const uint64_t particle,
+		const uint64_t draw);
+
+static void rotate(
+		const double r,
+		const double angle,
+		const double GM,
+		const double eps0,
+		const double enclosed,
+		double* x, double* y,
+		double* v_x, double* v_y);
+
+static void plummer(
+		const unsigned long seed,
+		const uint64_t i,
+		const double GM,
+		double* x, double* y,
+		double* v_x, double* v_y);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void generateParticles(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N,
+		const double G,
+		const double eps0,
+		const distribution_t distribution,
+		const int n_galaxies,
+		const unsigned long seed) {
+
+	const int galaxies = distribution == DISTRIBUTION_COLLISION ?
+			n_galaxies : 1;
+
+	long i;
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < N; i++) {
+
+		// Galaxies get consecutive particles
+		const int galaxy = i * galaxies / N;
+		const double GM = G * MEAN_MASS * N / galaxies;
+
+		particles->mass[i] = 0.5 + uniform(seed, i, 0);
+		brightness[i] = 1.5 + 3.5 * uniform(seed, i, 1);
+		const double angle = 2 * M_PI * uniform(seed, i, 2);
+		double x, y, v_x, v_y, r;
+		uint64_t draw;
+		switch (distribution) {
+			case DISTRIBUTION_UNIFORM:
+				r = DISK_RADIUS * sqrt(uniform(seed, i, 3));
+				rotate(r, angle, GM, eps0, r * r / (DISK_RADIUS * DISK_RADIUS),
+						&x, &y, &v_x, &v_y);
+				break;
+			case DISTRIBUTION_PLUMMER:
+				plummer(seed, i, GM, &x, &y, &v_x, &v_y);
+				break;
+			default:
+				// Radius r*exp(-r/h) is the sum of two exponential variates,
+				// leaving out the far tail
+				draw = 3;
+				do {
+					r = -DISK_SCALE * log(uniform(seed, i, draw)
+							* uniform(seed, i, draw + 1));
+					draw += 2;
+				} while (r > 8 * DISK_SCALE);
+				rotate(r, angle, GM, eps0,
+						1 - (1 + r / DISK_SCALE) * exp(-r / DISK_SCALE),
+						&x, &y, &v_x, &v_y);
+				break;
+		}
+
+		// Colliding galaxies are half the size, start on a circle and fall
+		// towards the centre
+		if (galaxies > 1) {
+			x *= 0.5;
+			y *= 0.5;
+			v_x *= M_SQRT2;
+			v_y *= M_SQRT2;
+			const double position = 2 * M_PI * galaxy / galaxies;
+			const double fall = 0.5 * sqrt(GM * galaxies / ORBIT_RADIUS);
+			x += ORBIT_RADIUS * cos(position);
+			y += ORBIT_RADIUS * sin(position);
+			v_x -= fall * cos(position + 0.3);
+			v_y -= fall * sin(position + 0.3);
+		}
+
+		particles->x[i] = 0.5 + x;
+		particles->y[i] = 0.5 + y;
+		particles->v_x[i] = v_x;
+		particles->v_y[i] = v_y;
+	}
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * SplitMix64 finalizer, a bijection that scrambles all bits of z.
+ */
+static uint64_t mix(uint64_t z) {
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+/**
+ * Returns draw number draw of particle particle, uniform in (0, 1).
+ */
+static double uniform(
+		const unsigned long seed,
+		const uint64_t particle,
+		const uint64_t draw) {
+
+	const uint64_t bits = mix(mix(seed ^ mix(particle))
+			+ draw * 0x9e3779b97f4a7c15ULL);
+	return ((bits >> 11) + 0.5) * 0x1.0p-53;
+}
+
+/**
+ * Places a particle at radius r and angle angle, moving on a circular orbit
+ * around a mass GM/G of which the fraction enclosed lies within r.
+ */
+static void rotate(
+		const double r,
+		const double angle,
+		const double GM,
+		const double eps0,
+		const double enclosed,
+		double* x, double* y,
+		double* v_x, double* v_y) {
+
+	// Softened force of calculateForces(), a = GM r / (r + eps0)^3, and
+	// circular speed v^2 = a r
+	const double v = r * sqrt(GM * enclosed / (r + eps0)) / (r + eps0);
+	*x = r * cos(angle);
+	*y = r * sin(angle);
+	*v_x = -v * sin(angle);
+	*v_y = v * cos(angle);
+}
+
+/**
+ * Draws a particle of a Plummer sphere of mass GM/G and keeps x and y of its
+ * position and velocity (Aarseth, Henon and Wielen 1974).
+ */
+static void plummer(
+		const unsigned long seed,
+		const uint64_t i,
+		const double GM,
+		double* x, double* y,
+		double* v_x, double* v_y) {
+
+	// Radius, leaving out the far tail
+	double r;
+	uint64_t draw = 3;
+	do {
+		const double m = uniform(seed, i, draw++);
+		r = PLUMMER_RADIUS / sqrt(pow(m, -2.0 / 3.0) - 1);
+	} while (r > 10 * PLUMMER_RADIUS);
+
+	// Speed as a fraction q of the escape speed, by rejection
+	double q, g;
+	do {
+		q = uniform(seed, i, draw++);
+		g = 0.1 * uniform(seed, i, draw++);
+	} while (g > q * q * pow(1 - q * q, 3.5));
+	const double v = q * sqrt(2 * GM)
+			* pow(r * r + PLUMMER_RADIUS * PLUMMER_RADIUS, -0.25);
+
+	// Isotropic directions
+	const double cosPosition = 2 * uniform(seed, i, draw++) - 1;
+	const double anglePosition = 2 * M_PI * uniform(seed, i, draw++);
+	const double cosVelocity = 2 * uniform(seed, i, draw++) - 1;
+	const double angleVelocity = 2 * M_PI * uniform(seed, i, draw++);
+	const double sinPosition = sqrt(1 - cosPosition * cosPosition);
+	const double sinVelocity = sqrt(1 - cosVelocity * cosVelocity);
+	*x = r * sinPosition * cos(anglePosition);
+	*y = r * sinPosition * sin(anglePosition);
+	*v_x = v * sinVelocity * cos(angleVelocity);
+	*v_y = v * sinVelocity * sin(angleVelocity);
+}
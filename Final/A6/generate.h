@@ -0,0 +1,44 @@
+/**
+ *	generate.h
+ *	Contains functions for generating initial conditions
+ *
+ *	Galaxies are placed in the unit square, like the .gal input files, with
+ *	masses between 0.5 and 1.5 and brightness between 1.5 and 5. Random
+ *	numbers come from a counter-based generator: draw k of particle i only
+ *	depends on the seed, i and k, so every thread count generates the same
+ *	particles.
+ */
+
+#pragma once
+#include "modules.h"
+
+// Initial particle distributions
+typedef enum distribution {
+	DISTRIBUTION_UNIFORM, // Uniform disk in circular rotation
+	DISTRIBUTION_PLUMMER, // Plummer sphere, projected onto the plane
+	DISTRIBUTION_EXPONENTIAL, // Exponential disk in circular rotation
+	DISTRIBUTION_COLLISION // Exponential disks falling towards each other
+} distribution_t;
+
+/**
+ * Generates N particles of the given distribution, using all threads.
+ *
+ * @param particles    Set to the generated particles.
+ * @param brightness   Set to the brightness of every particle.
+ * @param N            The total number of particles.
+ * @param G            Gravitational constant.
+ * @param eps0         Plummer sphere constant of the simulation, which the
+ *                     orbital speeds are set for.
+ * @param distribution Particle distribution.
+ * @param n_galaxies   Number of galaxies in DISTRIBUTION_COLLISION.
+ * @param seed         Random seed.
+ */
+void generateParticles(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N,
+		const double G,
+		const double eps0,
+		const distribution_t distribution,
+		const int n_galaxies,
+		const unsigned long seed);
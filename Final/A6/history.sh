@@ -0,0 +1,160 @@
+#!/bin/bash
+# Benchmark history of galsim, and a regression check against its best.
+#
+# ./history.sh record    Runs the benchmark REPS times and appends a row per
+#                        run to the history
+# ./history.sh compare   Runs the benchmark on the current build and compares
+#                        it with the best recorded run of the same CPU and
+#                        settings. Exits with 1 on a regression, 2 if there is
+#                        nothing to compare with.
+# ./history.sh show      Prints the history
+#
+# A row holds the run id, date, commit (-dirty with local changes), CPU,
+# compiler, CFLAGS, N, theta_max, threads, steps and the seconds of every
+# phase of the --timing report. The best run is the one with the lowest
+# median total. The current build regresses if its median total is more
+# than THRESHOLD slower and Welch's t statistic of the two runs is above
+# T_MIN, so noise between runs is not reported as a regression.
+#
+# RUN BY (from this folder, after make):
+# ./history.sh record
+# N=200000 THREADS=4 ./history.sh compare
+#
+# Settings, as environment variables:
+# N          Particles (100000)
+# THETA      theta_max (0.5)
+# THREADS    Threads (all processors)
+# STEPS      Timesteps of every run (10)
+# REPS       Runs (5)
+# DIST       Generated distribution, see --generate of galsim (plummer)
+# THRESHOLD  Relative slowdown that counts as a regression (0.05)
+# T_MIN      Smallest significant t statistic (2)
+# HISTORY    History file (bench_history.csv)
+
+N=${N:-100000}
+THETA=${THETA:-0.5}
+THREADS=${THREADS:-$(nproc)}
+STEPS=${STEPS:-10}
+REPS=${REPS:-5}
+DIST=${DIST:-plummer}
+THRESHOLD=${THRESHOLD:-0.05}
+T_MIN=${T_MIN:-2}
+HISTORY=${HISTORY:-bench_history.csv}
+
+HEADER="run,date,commit,cpu,compiler,cflags,distribution,N,theta,threads,steps,total,read,build,force,free,write"
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+case "$1" in
+	record|compare) ;;
+	show)
+		[ -f "$HISTORY" ] && cat "$HISTORY"
+		exit 0 ;;
+	*)
+		echo "Usage: $0 record|compare|show"
+		exit 1 ;;
+esac
+[ -x ./galsim ] || { echo "ERROR: Build galsim first (make)."; exit 1; }
+
+# Build and machine description, commas removed for the CSV
+commit=$(git rev-parse --short HEAD 2> /dev/null || echo unknown)
+git diff --quiet HEAD -- . 2> /dev/null || commit="$commit-dirty"
+cpu=$(grep -m 1 "model name" /proc/cpuinfo | cut -d: -f2 | sed 's/^ *//')
+compiler=$(${CC:-gcc} --version | head -1)
+cflags=$(make -pn galsim 2> /dev/null | awk -F' = ' '/^CFLAGS = / { print $2; exit }')
+run=$(date +%Y%m%d%H%M%S)
+describe="$run,$(date -Iseconds),$commit,${cpu//,/ },${compiler//,/ },${cflags//,/ }"
+describe="$describe,$DIST,$N,$THETA,$THREADS,$STEPS"
+
+# Runs the benchmark REPS times, one row per run into $WORK/runs.csv
+for ((rep = 0; rep < REPS; rep++)); do
+	start=$(date +%s.%N)
+	./galsim "$N" - "$STEPS" 1e-5 "$THETA" 0 "$THREADS" --generate "$DIST" \
+			--output "$WORK/result.gal" --timing "$WORK/timing.csv" \
+			> /dev/null || { echo "ERROR: galsim failed."; exit 1; }
+	stop=$(date +%s.%N)
+	awk -F, -v describe="$describe" -v start="$start" -v stop="$stop" '
+		$1 == "" && NR > 1 { t[$2] = $4 }
+		$1 == "total" { t[$2] = $5 }
+		END { printf "%s,%.6f,%.9f,%.9f,%.9f,%.9f,%.9f\n", describe,
+				stop - start, t["read"], t["build"], t["force"], t["free"],
+				t["write"] }' "$WORK/timing.csv" >> "$WORK/runs.csv"
+done
+
+if [ "$1" = record ]; then
+	[ -f "$HISTORY" ] || echo "$HEADER" > "$HISTORY"
+	cat "$WORK/runs.csv" >> "$HISTORY"
+	echo "Recorded $REPS runs of $commit as run $run in $HISTORY"
+	exit 0
+fi
+
+# Compare with the best run of this CPU and these settings
+[ -f "$HISTORY" ] || { echo "No history in $HISTORY, record a run first."; exit 2; }
+awk -F, -v cpu="${cpu//,/ }" -v dist="$DIST" -v n="$N" -v theta="$THETA" \
+		-v threads="$THREADS" -v steps="$STEPS" -v threshold="$THRESHOLD" \
+		-v tmin="$T_MIN" '
+	function median(values, n,    i, j, v, sorted) {
+		for (i = 1; i <= n; i++) sorted[i] = values[i]
+		for (i = 2; i <= n; i++) {
+			v = sorted[i]
+			for (j = i - 1; j > 0 && sorted[j] > v; j--) sorted[j + 1] = sorted[j]
+			sorted[j + 1] = v
+		}
+		return n % 2 ? sorted[(n + 1) / 2] : (sorted[n / 2] + sorted[n / 2 + 1]) / 2
+	}
+	function moments(values, n, stats,    i, mean, sq) {
+		mean = 0
+		for (i = 1; i <= n; i++) mean += values[i] / n
+		sq = 0
+		for (i = 1; i <= n; i++) sq += (values[i] - mean) ^ 2
+		stats["mean"] = mean
+		stats["var"] = n > 1 ? sq / (n - 1) : 0
+	}
+	# Stored runs of the same CPU and settings, per run id
+	FNR == 1 { current = FILENAME == ARGV[1] }
+	!current && FNR > 1 && $4 == cpu && $7 == dist && $8 == n && $9 == theta \
+			&& $10 == threads && $11 == steps {
+		count[$1]++
+		total[$1, count[$1]] = $12
+		commitOf[$1] = $3
+	}
+	current {
+		m++
+		now[m] = $12
+		for (p = 12; p <= 17; p++) nowPhase[p, m] = $p
+		header = "total,read,build,force,free,write"
+	}
+	END {
+		best = ""
+		for (r in count) {
+			for (i = 1; i <= count[r]; i++) v[i] = total[r, i]
+			med = median(v, count[r])
+			if (best == "" || med < bestMedian) { best = r; bestMedian = med }
+		}
+		if (best == "") {
+			print "No stored run of this CPU and these settings to compare with."
+			exit 2
+		}
+		for (i = 1; i <= count[best]; i++) ref[i] = total[best, i]
+		nowMedian = median(now, m)
+		moments(ref, count[best], a)
+		moments(now, m, b)
+		se = sqrt(a["var"] / count[best] + b["var"] / m)
+		t = se > 0 ? (b["mean"] - a["mean"]) / se : (b["mean"] > a["mean"] ? 1e9 : 0)
+		change = nowMedian / bestMedian - 1
+		printf "Best: run %s (%s), median %.6f s over %d runs\n", best,
+				commitOf[best], bestMedian, count[best]
+		printf "Now:  median %.6f s over %d runs, %+.1f%%, t = %.2f\n",
+				nowMedian, m, 100 * change, t
+		split(header, names, ",")
+		for (p = 13; p <= 17; p++) {
+			for (i = 1; i <= m; i++) w[i] = nowPhase[p, i]
+			printf "      %s %.6f s\n", names[p - 11], median(w, m)
+		}
+		if (change > threshold && t > tmin) {
+			printf "REGRESSION: more than %.1f%% slower than the best run\n",
+					100 * threshold
+			exit 1
+		}
+		print "No regression"
+	}' "$WORK/runs.csv" "$HISTORY"
@@ -1,4 +1,41 @@
 #include "io.h"
+#include "codec.h"
+#include <stdlib.h>
+
+#define WRITE_BLOCK 65536 // Particles per write of writeOutput()
+#define CHECKPOINT_MAGIC "GALCKPT1"
+#define CHECKPOINT_HEADER 64 // Bytes before the particle records
+
+// Galaxy v2 columns, in the order they are written
+static const char* galaxyFields[GALAXY_FIELDS] =
+		{ "x", "y", "mass", "v_x", "v_y", "brightness" };
+
+/*******************************************************************************
+STATIC FUNCTION DECLARATIONS
+*******************************************************************************/
+
+static int readRecords(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const int fd,
+		const size_t fileSize,
+		const size_t offset,
+		const long N);
+
+static int writeRecords(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const int fd,
+		const size_t offset,
+		const long N);
+
+static int checkGalaxyHeader(
+		const galaxyHeader_t* header,
+		const size_t fileSize);
+
+static int galaxyColumns(
+		const galaxyHeader_t* header,
+		size_t offsets[GALAXY_FIELDS]);
 
 /*******************************************************************************
 FUNCTION DEFINITIONS
@@ -8,44 +45,66 @@ FUNCTION DEFINITIONS
 int readData(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const char* filename, const int N) {
+		const char* filename, const long N) {
+
+	// Galaxy v2 file: copy the columns of the mapped file
+	if (isGalaxyFile(filename)) {
+		particles_t columns;
+		double* brightnessColumn;
+		galaxyMap_t map;
+		if (mapGalaxy(&columns, &brightnessColumn, &map, filename)) {
+			return 1;
+		}
+		if (((galaxyHeader_t*) map.data)->N != N) {
+			printf("%s\n", "ERROR: Input file holds another N. Is N correct?");
+			unmapGalaxy(&map);
+			return 1;
+		}
+		long i;
+		#pragma omp parallel for simd schedule(static)
+		for (i = 0; i < N; i++) {
+			particles->x[i] = columns.x[i];
+			particles->y[i] = columns.y[i];
+			particles->mass[i] = columns.mass[i];
+			particles->v_x[i] = columns.v_x[i];
+			particles->v_y[i] = columns.v_y[i];
+			brightness[i] = brightnessColumn[i];
+		}
+		unmapGalaxy(&map);
+		return 0;
+	}
 
 	// Open file
-	FILE* fp = fopen(filename, "r");
+	int fd = open(filename, O_RDONLY);
 
 	// Check file open went ok
-	if (!fp) {
+	if (fd < 0) {
 		printf("%s\n", "ERROR: Failed to open input file. Is it in directory?");
 		return 1;
 	}
 
 	// Check file size is as expected
-	fseek(fp, 0L, SEEK_END); // Seek end
-	size_t fileSize = ftell(fp); // Get file size
-	fseek(fp, 0L, SEEK_SET); // Reset seek to start of file
+	struct stat fileStat;
+	if (fstat(fd, &fileStat)) {
+		printf("%s\n", "ERROR: Failed to get input file size.");
+		close(fd);
+		return 1;
+	}
+	size_t fileSize = fileStat.st_size; // Get file size
 	if (fileSize != 6*N*sizeof(double)) { // File size not as expected?
 		printf("%s\n", "ERROR: Input file size is not as expected. Is N correct?");
+		close(fd);
 		return 1;
 	}
 
 	// Read file
-	unsigned int i;
-	for (i = 0; i < N; i++) {
-		if (
-				fread(&(particles->x[i]), sizeof(double), 1, fp) &&
-				fread(&(particles->y[i]), sizeof(double), 1, fp) &&
-				fread(&(particles->mass[i]), sizeof(double), 1, fp)  &&
-				fread(&(particles->v_x[i]), sizeof(double), 1, fp)  &&
-				fread(&(particles->v_y[i]), sizeof(double), 1, fp)  &&
-				fread(&brightness[i], sizeof(double), 1, fp)) {
-			// Do nothing
-		} else {
-			printf("ERROR: Failed to read particle %d from input file\n", i);
-			return 1;
-		}
+	if (readRecords(particles, brightness, fd, fileSize, 0, N)) {
+		close(fd);
+		return 1;
 	}
+
 	// Close file
-	if (fclose(fp)) {
+	if (close(fd)) {
 		// Fail
 		printf("%s\n", "ERROR: Failed to close input file.");
 		return 1;
@@ -59,37 +118,412 @@ int readData(
 int writeOutput(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const int N) {
+		const long N,
+		const char* filename) {
 
 	// Create file to write
-	FILE* fp = fopen("result.gal", "w");
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
 
 	// Check file creation went ok
-	if (!fp) {
+	if (fd < 0) {
 		printf("%s\n", "ERROR: Failed to create output file");
 		return 1;
 	}
 
 	// Write to file
-	unsigned int i;
-	for (i = 0; i < N; i++) {
-		if (
-				fwrite(&(particles->x[i]), sizeof(double), 1, fp) &&
-				fwrite(&(particles->y[i]), sizeof(double), 1, fp) &&
-				fwrite(&(particles->mass[i]), sizeof(double), 1, fp)  &&
-				fwrite(&(particles->v_x[i]), sizeof(double), 1, fp)  &&
-				fwrite(&(particles->v_y[i]), sizeof(double), 1, fp)  &&
-				fwrite(&brightness[i], sizeof(double), 1, fp)) {
-			// Do nothing
+	if (writeRecords(particles, brightness, fd, 0, N)) {
+		printf("%s\n", "ERROR: Failed to write output file.");
+		close(fd);
+		return 1;
+	}
+
+	// Close file
+	if (close(fd)) {
+		// Fail
+		printf("%s\n", "ERROR: Failed to close output file.");
+		return 1;
+	}
+
+	// Success
+	return 0;
+}
+
+// Write checkpoint to a temporary file, then move it in place
+int writeCheckpoint(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		simulationConstants_t* __restrict simulationConstants,
+		const int step,
+		const long trajectoryEnd,
+		const char* filename) {
+
+	const long N = *simulationConstants->N;
+
+	// Create temporary file next to the checkpoint
+	char tmpFilename[strlen(filename) + 5];
+	sprintf(tmpFilename, "%s.tmp", filename);
+	int fd = open(tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("%s\n", "ERROR: Failed to create checkpoint file");
+		return 1;
+	}
+
+	// Header with the step, the constants the run depends on and the end of
+	// the trajectory
+	char header[CHECKPOINT_HEADER];
+	memset(header, 0, CHECKPOINT_HEADER);
+	const long counts[2] = { N, step };
+	const double constants[4] = {
+		*simulationConstants->delta_t,
+		*simulationConstants->theta_max,
+		*simulationConstants->G,
+		*simulationConstants->eps0 };
+	memcpy(header, CHECKPOINT_MAGIC, 8);
+	memcpy(header + 8, counts, sizeof(counts));
+	memcpy(header + 24, constants, sizeof(constants));
+	memcpy(header + 56, &trajectoryEnd, sizeof(long));
+
+	// Header, particles in .gal layout, then flush to disk
+	if (pwrite(fd, header, CHECKPOINT_HEADER, 0) != CHECKPOINT_HEADER
+			|| writeRecords(particles, brightness, fd, CHECKPOINT_HEADER, N)
+			|| fsync(fd)) {
+		printf("%s\n", "ERROR: Failed to write checkpoint file.");
+		close(fd);
+		return 1;
+	}
+	if (close(fd)) {
+		printf("%s\n", "ERROR: Failed to close checkpoint file.");
+		return 1;
+	}
+
+	// Replace the old checkpoint in one step
+	if (rename(tmpFilename, filename)) {
+		printf("%s\n", "ERROR: Failed to rename checkpoint file.");
+		return 1;
+	}
+
+	// Success
+	return 0;
+}
+
+// Read checkpoint and check it belongs to this run
+int readCheckpoint(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		simulationConstants_t* __restrict simulationConstants,
+		int* step,
+		long* trajectoryEnd,
+		const char* filename) {
+
+	const long N = *simulationConstants->N;
+
+	// Open file
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("%s\n", "ERROR: Failed to open checkpoint file.");
+		return 1;
+	}
+
+	// Check header
+	char header[CHECKPOINT_HEADER];
+	long counts[2];
+	double constants[4];
+	struct stat fileStat;
+	if (pread(fd, header, CHECKPOINT_HEADER, 0) != CHECKPOINT_HEADER
+			|| fstat(fd, &fileStat)
+			|| memcmp(header, CHECKPOINT_MAGIC, 8)) {
+		printf("%s\n", "ERROR: Not a checkpoint file.");
+		close(fd);
+		return 1;
+	}
+	memcpy(counts, header + 8, sizeof(counts));
+	memcpy(constants, header + 24, sizeof(constants));
+	if (counts[0] != N
+			|| constants[0] != *simulationConstants->delta_t
+			|| constants[1] != *simulationConstants->theta_max
+			|| constants[2] != *simulationConstants->G
+			|| constants[3] != *simulationConstants->eps0) {
+		printf("%s\n", "ERROR: Checkpoint does not match N, delta_t, "
+				"theta_max, G or eps0.");
+		close(fd);
+		return 1;
+	}
+	size_t fileSize = fileStat.st_size;
+	if (fileSize != CHECKPOINT_HEADER + 6*N*sizeof(double)) {
+		printf("%s\n", "ERROR: Checkpoint file size is not as expected.");
+		close(fd);
+		return 1;
+	}
+	*step = (int) counts[1];
+	memcpy(trajectoryEnd, header + 56, sizeof(long));
+
+	// Read particles
+	if (readRecords(particles, brightness, fd, fileSize, CHECKPOINT_HEADER,
+				N)) {
+		close(fd);
+		return 1;
+	}
+
+	// Close file
+	if (close(fd)) {
+		printf("%s\n", "ERROR: Failed to close checkpoint file.");
+		return 1;
+	}
+
+	// Success
+	return 0;
+}
+
+// Read a trajectory frame, decoding from the last keyframe
+int readTrajectoryFrame(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N,
+		const int frame,
+		int* step,
+		const char* filename) {
+
+	// Open and map file
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("%s\n", "ERROR: Failed to open trajectory file.");
+		return 1;
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat)) {
+		printf("%s\n", "ERROR: Failed to get trajectory file size.");
+		close(fd);
+		return 1;
+	}
+	const size_t fileSize = fileStat.st_size;
+	const char* file = fileSize ? (const char*) mmap(NULL, fileSize, PROT_READ,
+			MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (file == MAP_FAILED) {
+		printf("%s\n", "ERROR: Failed to map trajectory file.");
+		return 1;
+	}
+
+	// Check header and frame index
+	long header[4] = { 0 };
+	if (fileSize >= sizeof(header)) {
+		memcpy(header, file, sizeof(header));
+	}
+	const size_t columns = sizeof(header) + 2 * (size_t) N * sizeof(double);
+	if (memcmp(header, SNAPSHOT_MAGIC, 8) || header[1] != N
+			|| frame < 0 || frame >= header[2] || header[3] < columns
+			|| header[3] + 2 * header[2] * sizeof(long) > fileSize) {
+		printf("%s\n", "ERROR: Not a trajectory file with N particles and that frame.");
+		munmap((void*) file, fileSize);
+		return 1;
+	}
+	const long* index = (const long*) (file + header[3]);
+
+	// Frame headers: step, encoding and payload size
+	long frameHeader[3];
+	int first; // Keyframe to decode from
+	for (first = frame; first >= 0; first--) {
+		const size_t offset = index[2*first + 1];
+		if (offset < columns
+				|| offset + sizeof(frameHeader) + sizeof(long) > header[3]) {
+			first = -1;
+			break;
+		}
+		memcpy(frameHeader, file + offset, sizeof(frameHeader));
+		if (frameHeader[1] == SNAPSHOT_RAW || isKeyframe((const unsigned char*)
+					(file + offset + sizeof(frameHeader)))) {
+			break;
+		}
+	}
+	int failed = first < 0;
+
+	// Decode frames up to the requested one
+	double* buffer = (double*) malloc(4 * N * sizeof(double));
+	codecState_t* codec = NULL;
+	failed |= !buffer;
+	int f;
+	for (f = first; f <= frame && !failed; f++) {
+		const size_t offset = index[2*f + 1];
+		memcpy(frameHeader, file + offset, sizeof(frameHeader));
+		const unsigned char* payload = (const unsigned char*) (file + offset
+				+ sizeof(frameHeader));
+		const size_t size = frameHeader[2];
+		if (offset + sizeof(frameHeader) + size > header[3]) {
+			failed = 1;
+		} else if (frameHeader[1] == SNAPSHOT_RAW) {
+			failed = size != 4 * N * sizeof(double);
+			if (!failed) {
+				memcpy(buffer, payload, size);
+			}
 		} else {
-			printf("ERROR: Failed to write particle %d to output file\n", i);
-			return 1;
+			if (!codec) {
+				codec = codecCreate(N, frameHeader[1], 0);
+			}
+			failed = !codec || decodeFrame(codec, payload, size, buffer);
 		}
+		*step = (int) frameHeader[0];
+	}
+	if (failed) {
+		printf("%s\n", "ERROR: Failed to decode trajectory frame.");
+	} else {
+		// Split frame and constant columns into the particle arrays
+		const double* constant = (const double*) (file + sizeof(header));
+		memcpy(particles->x, buffer, N * sizeof(double));
+		memcpy(particles->y, buffer + N, N * sizeof(double));
+		memcpy(particles->v_x, buffer + 2*N, N * sizeof(double));
+		memcpy(particles->v_y, buffer + 3*N, N * sizeof(double));
+		memcpy(particles->mass, constant, N * sizeof(double));
+		memcpy(brightness, constant + N, N * sizeof(double));
+	}
+
+	codecFree(codec);
+	free(buffer);
+	munmap((void*) file, fileSize);
+
+	return failed;
+}
+
+// Check the magic of a galaxy v2 file
+int isGalaxyFile(const char* filename) {
+
+	char magic[8] = { 0 };
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return 0;
+	}
+	const int isGalaxy = pread(fd, magic, sizeof(magic), 0) == sizeof(magic)
+			&& !memcmp(magic, GALAXY_MAGIC, sizeof(magic));
+	close(fd);
+
+	return isGalaxy;
+}
+
+// Read the header of a galaxy v2 file
+int readGalaxyHeader(galaxyHeader_t* header, const char* filename) {
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("%s\n", "ERROR: Failed to open input file. Is it in directory?");
+		return 1;
+	}
+	struct stat fileStat;
+	int failed = fstat(fd, &fileStat)
+			|| pread(fd, header, sizeof(galaxyHeader_t), 0)
+					!= sizeof(galaxyHeader_t)
+			|| checkGalaxyHeader(header, fileStat.st_size);
+	close(fd);
+	if (failed) {
+		printf("%s\n", "ERROR: Not a galaxy v2 file.");
+	}
+
+	return failed;
+}
+
+// Map a galaxy v2 file and point the particle arrays at its columns
+int mapGalaxy(
+		particles_t* __restrict particles,
+		double** brightness,
+		galaxyMap_t* map,
+		const char* filename) {
+
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		printf("%s\n", "ERROR: Failed to open input file. Is it in directory?");
+		return 1;
+	}
+
+	// Check the header of the file mapped, so its columns lie inside it
+	galaxyHeader_t header;
+	struct stat fileStat;
+	if (fstat(fd, &fileStat)
+			|| pread(fd, &header, sizeof(galaxyHeader_t), 0)
+					!= sizeof(galaxyHeader_t)
+			|| checkGalaxyHeader(&header, fileStat.st_size)) {
+		printf("%s\n", "ERROR: Not a galaxy v2 file.");
+		close(fd);
+		return 1;
+	}
+
+	// Private writable mapping, pages are only copied when written
+	map->size = GALAXY_HEADER + header.n_fields * header.stride;
+	map->data = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+			fd, 0);
+	close(fd);
+	if (map->data == MAP_FAILED) {
+		printf("%s\n", "ERROR: Failed to map input file.");
+		map->data = NULL;
+		return 1;
+	}
+	madvise(map->data, map->size, MADV_WILLNEED);
+
+	size_t offsets[GALAXY_FIELDS];
+	galaxyColumns(&header, offsets);
+	char* data = (char*) map->data;
+	particles->x = (double*) (data + offsets[0]);
+	particles->y = (double*) (data + offsets[1]);
+	particles->mass = (double*) (data + offsets[2]);
+	particles->v_x = (double*) (data + offsets[3]);
+	particles->v_y = (double*) (data + offsets[4]);
+	*brightness = (double*) (data + offsets[5]);
+
+	return 0;
+}
+
+void unmapGalaxy(galaxyMap_t* map) {
+
+	if (map->data) {
+		munmap(map->data, map->size);
+		map->data = NULL;
+	}
+}
+
+// Write a galaxy v2 file, one column per thread
+int writeGalaxy(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		galaxyHeader_t* header,
+		const char* filename) {
+
+	// Complete header
+	memcpy(header->magic, GALAXY_MAGIC, sizeof(header->magic));
+	header->version = GALAXY_VERSION;
+	header->n_fields = GALAXY_FIELDS;
+	header->stride = (header->N * sizeof(double) + GALAXY_ALIGN - 1)
+			/ GALAXY_ALIGN * GALAXY_ALIGN;
+	memset(header->fields, 0, sizeof(header->fields));
+	unsigned int i;
+	for (i = 0; i < GALAXY_FIELDS; i++) {
+		strcpy(header->fields[i], galaxyFields[i]);
+	}
+	const double* columns[GALAXY_FIELDS] = { particles->x, particles->y,
+			particles->mass, particles->v_x, particles->v_y, brightness };
+
+	// Create file to write
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("%s\n", "ERROR: Failed to create output file");
+		return 1;
+	}
+
+	// Padded header, zeroed column padding, then the columns
+	char padded[GALAXY_HEADER];
+	memset(padded, 0, GALAXY_HEADER);
+	memcpy(padded, header, sizeof(galaxyHeader_t));
+	int failed = writeAll(fd, padded, GALAXY_HEADER, 0)
+			|| ftruncate(fd, GALAXY_HEADER + GALAXY_FIELDS * header->stride);
+	#pragma omp parallel for schedule(dynamic) reduction(|:failed)
+	for (i = 0; i < GALAXY_FIELDS; i++) {
+		failed |= writeAll(fd, columns[i], header->N * sizeof(double),
+				GALAXY_HEADER + i * header->stride);
+	}
+	if (failed) {
+		printf("%s\n", "ERROR: Failed to write output file.");
+		close(fd);
+		return 1;
 	}
 
 	// Close file
-	if (fclose(fp)) {
-		// Fail
+	if (close(fd)) {
 		printf("%s\n", "ERROR: Failed to close output file.");
 		return 1;
 	}
@@ -97,3 +531,168 @@ int writeOutput(
 	// Success
 	return 0;
 }
+
+// Write size bytes at offset, retrying partial writes
+int writeAll(int fd, const void* data, size_t size, off_t offset) {
+
+	const char* bytes = (const char*) data;
+	while (size) {
+		ssize_t written = pwrite(fd, bytes, size, offset);
+		if (written <= 0) {
+			return 1;
+		}
+		bytes += written;
+		size -= written;
+		offset += written;
+	}
+	return 0;
+}
+
+/*******************************************************************************
+STATIC FUNCTION DEFINITIONS
+*******************************************************************************/
+
+/**
+ * Maps the open file fd and splits the N interleaved .gal records starting
+ * at byte offset into the particle arrays, using all threads. Each thread
+ * reads its own part of the file. Returns 0 on success, else 1.
+ */
+static int readRecords(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const int fd,
+		const size_t fileSize,
+		const size_t offset,
+		const long N) {
+
+	// Nothing to map if empty
+	if (!N) {
+		return 0;
+	}
+
+	// Map the whole file
+	const char* file = (const char*) mmap(NULL, fileSize, PROT_READ,
+			MAP_PRIVATE, fd, 0);
+	if (file == MAP_FAILED) {
+		printf("%s\n", "ERROR: Failed to map input file.");
+		return 1;
+	}
+	madvise((void*) file, fileSize, MADV_WILLNEED);
+	const double* data = (const double*) (file + offset);
+
+	// Transpose the interleaved records into the particle arrays
+	long i;
+	#pragma omp parallel for simd schedule(static)
+	for (i = 0; i < N; i++) {
+		particles->x[i] = data[6*i];
+		particles->y[i] = data[6*i + 1];
+		particles->mass[i] = data[6*i + 2];
+		particles->v_x[i] = data[6*i + 3];
+		particles->v_y[i] = data[6*i + 4];
+		brightness[i] = data[6*i + 5];
+	}
+
+	munmap((void*) file, fileSize);
+
+	return 0;
+}
+
+/**
+ * Writes the particles as N interleaved .gal records to the open file fd,
+ * starting at byte offset. Every thread interleaves blocks of the particles
+ * into its own buffer and writes each block at its place in the file.
+ * Returns 0 on success, else 1.
+ */
+static int writeRecords(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const int fd,
+		const size_t offset,
+		const long N) {
+
+	int failed = 0;
+	#pragma omp parallel reduction(|:failed)
+	{
+		double* buffer = (double*) malloc(6 * WRITE_BLOCK * sizeof(double));
+		failed = !buffer;
+
+		long iBlock;
+		#pragma omp for schedule(static)
+		for (iBlock = 0; iBlock < N; iBlock += WRITE_BLOCK) {
+			if (failed) {
+				continue;
+			}
+
+			// Interleave the block into .gal records
+			const long n = N - iBlock < WRITE_BLOCK ?
+					N - iBlock : WRITE_BLOCK;
+			long i;
+			for (i = 0; i < n; i++) {
+				buffer[6*i] = particles->x[iBlock + i];
+				buffer[6*i + 1] = particles->y[iBlock + i];
+				buffer[6*i + 2] = particles->mass[iBlock + i];
+				buffer[6*i + 3] = particles->v_x[iBlock + i];
+				buffer[6*i + 4] = particles->v_y[iBlock + i];
+				buffer[6*i + 5] = brightness[iBlock + i];
+			}
+
+			// Write it at its place in the file
+			failed = writeAll(fd, buffer, 6 * n * sizeof(double),
+					offset + (off_t) iBlock * 6 * sizeof(double));
+		}
+
+		free(buffer);
+	}
+
+	return failed;
+}
+
+/**
+ * Checks that a galaxy v2 header is valid for a file of fileSize bytes and
+ * names every field. Every field is bounded before it is multiplied, so a
+ * corrupt header cannot overflow into columns outside the file. Returns 0 if
+ * valid, else 1.
+ */
+static int checkGalaxyHeader(
+		const galaxyHeader_t* header,
+		const size_t fileSize) {
+
+	if (memcmp(header->magic, GALAXY_MAGIC, sizeof(header->magic))
+			|| header->version != GALAXY_VERSION
+			|| header->N < 0 || header->n_fields != GALAXY_FIELDS
+			|| header->stride <= 0 || header->stride % GALAXY_ALIGN
+			|| (size_t) header->N > (size_t) header->stride / sizeof(double)
+			|| fileSize < GALAXY_HEADER
+			|| (size_t) header->stride
+					> (fileSize - GALAXY_HEADER) / header->n_fields) {
+		return 1;
+	}
+
+	size_t offsets[GALAXY_FIELDS];
+	return galaxyColumns(header, offsets);
+}
+
+/**
+ * Sets the file offset of the column of every field of galaxyFields in a
+ * galaxy v2 file. Returns 0 on success, 1 if a field is missing.
+ */
+static int galaxyColumns(
+		const galaxyHeader_t* header,
+		size_t offsets[GALAXY_FIELDS]) {
+
+	unsigned int i, j;
+	for (i = 0; i < GALAXY_FIELDS; i++) {
+		for (j = 0; j < header->n_fields; j++) {
+			if (!strncmp(header->fields[j], galaxyFields[i],
+						sizeof(header->fields[j]))) {
+				break;
+			}
+		}
+		if (j == header->n_fields) {
+			return 1;
+		}
+		offsets[i] = GALAXY_HEADER + j * header->stride;
+	}
+
+	return 0;
+}
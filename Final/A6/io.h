@@ -1,38 +1,214 @@
 /**
  *	io.h
  * 	Contains functions for reading and writing .gal files
+ *
+ *	Legacy .gal files hold N interleaved records of x, y, mass, v_x, v_y and
+ *	brightness. Galaxy v2 files start with a galaxyHeader_t padded to
+ *	GALAXY_HEADER bytes, followed by one column of N doubles per field, each
+ *	column starting GALAXY_ALIGN-aligned, stride bytes after the last.
  */
 
 #pragma once
 #include "modules.h"
 #include <string.h>
 #include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define GALAXY_MAGIC "GALAXY2"
+#define GALAXY_VERSION 2
+#define GALAXY_HEADER 256 // Bytes before the first column
+#define GALAXY_ALIGN 64 // Alignment of every column in the file
+#define GALAXY_FIELDS 6
+
+// Header of a galaxy v2 file
+typedef struct galaxyHeader {
+	char magic[8];
+	long version;
+	long N;
+	long step; // Timesteps simulated, 0 for initial conditions
+	long n_fields;
+	long stride; // Bytes from the start of one column to the next
+	double delta_t; // Simulation constants, 0 if not known
+	double theta_max;
+	double G;
+	double eps0;
+	char fields[GALAXY_FIELDS][16]; // Column names in file order
+} galaxyHeader_t;
+
+// Galaxy v2 file mapped into memory
+typedef struct galaxyMap {
+	void* data;
+	size_t size;
+} galaxyMap_t;
 
 /**
  * Reads galaxy data from input file "filename" into particle_t* array
  * particles. Galaxy brightness is stored in separate array double* brightness
- * for speed as brightness isn't used in calculations. Returns 0 if data was
- * read successfully, 1 otherwise.
+ * for speed as brightness isn't used in calculations. The file is mapped into
+ * memory and its records are split into the arrays by all threads. Galaxy v2
+ * files are recognized by their header and their columns copied. Returns 0
+ * if data was read successfully, 1 otherwise.
  *
  * @param  particles  Information about every particle.
  * @param  brightness Array with brightness information about every particle.
  * @param  filename   The input data filename (ending with ".gal").
  * @param  N          The total number of particles.
- * @return            Returns 1 if data was read successfully, else 0.
+ * @return            Returns 0 if data was read successfully, else 1.
  */
  int readData(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const char* filename, const int N);
+		const char* filename, const long N);
 
 /**
- * Writes current state of all particles to output file "result.gal".
+ * Writes current state of all particles to output file "filename". The
+ * threads interleave the particles into .gal records in large blocks and
+ * write each block at its offset in the file.
  *
  * @param particles  Information about every particle.
  * @param brightness Array with brightness information about every particle.
  * @param N          The total number of particles.
+ * @param filename   The output data filename, usually "result.gal".
+ * @return           Returns 0 if data was written successfully, else 1.
  */
  int writeOutput(
 		particles_t* __restrict particles,
 		double* __restrict brightness,
-		const int N);
+		const long N,
+		const char* filename);
+
+/**
+ * Writes a checkpoint of the run after timestep step to "filename": a header
+ * with N, step, the simulation constants and the end of the trajectory, then
+ * the particles in .gal layout. The checkpoint is written to "filename.tmp",
+ * flushed to disk and then renamed, so "filename" always holds a complete
+ * checkpoint.
+ *
+ * @param particles           Information about every particle.
+ * @param brightness          Brightness of every particle.
+ * @param simulationConstants Simulation constants of the run.
+ * @param step                Number of timesteps done.
+ * @param trajectoryEnd       End of the trajectory from snapshotSync(), or
+ *                            0 without snapshots.
+ * @param filename            Checkpoint filename.
+ * @return                    Returns 0 if written successfully, else 1.
+ */
+int writeCheckpoint(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		simulationConstants_t* __restrict simulationConstants,
+		const int step,
+		const long trajectoryEnd,
+		const char* filename);
+
+/**
+ * Reads a checkpoint written by writeCheckpoint(). Fails unless N, delta_t,
+ * theta_max, G and eps0 are the same as in simulationConstants, since the
+ * run could not continue as it would have.
+ *
+ * @param particles           Information about every particle.
+ * @param brightness          Brightness of every particle.
+ * @param simulationConstants Simulation constants of this run.
+ * @param step                Set to the number of timesteps done.
+ * @param trajectoryEnd       Set to the end of the trajectory to continue,
+ *                            0 if the run wrote none.
+ * @param filename            Checkpoint filename.
+ * @return                    Returns 0 if read successfully, else 1.
+ */
+int readCheckpoint(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		simulationConstants_t* __restrict simulationConstants,
+		int* step,
+		long* trajectoryEnd,
+		const char* filename);
+
+/**
+ * Reads frame number frame of a trajectory written by snapshotOpen() into
+ * particles and brightness. Compressed frames are decoded in order from the
+ * keyframe before them.
+ *
+ * @param particles  Information about every particle.
+ * @param brightness Brightness of every particle.
+ * @param N          The total number of particles.
+ * @param frame      Frame number, 0 is the initial state.
+ * @param step       Set to the timestep of the frame.
+ * @param filename   Trajectory filename.
+ * @return           Returns 0 if read successfully, else 1.
+ */
+int readTrajectoryFrame(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N,
+		const int frame,
+		int* step,
+		const char* filename);
+
+/**
+ * Returns 1 if "filename" starts with the galaxy v2 magic, else 0.
+ *
+ * @param filename Galaxy filename.
+ */
+int isGalaxyFile(const char* filename);
+
+/**
+ * Reads and checks the header of galaxy v2 file "filename".
+ *
+ * @param header   Set to the header.
+ * @param filename Galaxy v2 filename.
+ * @return         Returns 0 if read successfully, else 1.
+ */
+int readGalaxyHeader(galaxyHeader_t* header, const char* filename);
+
+/**
+ * Maps galaxy v2 file "filename" privately into memory and points the
+ * particle arrays and brightness at its columns, without copying. Changes to
+ * the particles do not reach the file. Release with unmapGalaxy() instead of
+ * freeing the arrays.
+ *
+ * @param particles  Set to point at the columns.
+ * @param brightness Set to point at the brightness column.
+ * @param map        Set to the mapping.
+ * @param filename   Galaxy v2 filename.
+ * @return           Returns 0 if mapped successfully, else 1.
+ */
+int mapGalaxy(
+		particles_t* __restrict particles,
+		double** brightness,
+		galaxyMap_t* map,
+		const char* filename);
+
+/**
+ * Unmaps a file mapped by mapGalaxy().
+ *
+ * @param map Mapping.
+ */
+void unmapGalaxy(galaxyMap_t* map);
+
+/**
+ * Writes the particles as galaxy v2 file "filename". The magic, version,
+ * field list and stride of header are filled in, N, step and the constants
+ * are written as given.
+ *
+ * @param particles  Information about every particle.
+ * @param brightness Brightness of every particle.
+ * @param header     Header with N, step and simulation constants.
+ * @param filename   Galaxy v2 filename.
+ * @return           Returns 0 if written successfully, else 1.
+ */
+int writeGalaxy(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		galaxyHeader_t* header,
+		const char* filename);
+
+/**
+ * Writes size bytes of data at byte offset of the open file fd, retrying
+ * partial writes.
+ *
+ * @return Returns 0 on success, else 1.
+ */
+int writeAll(int fd, const void* data, size_t size, off_t offset);
@@ -1,5 +1,52 @@
 // RUN BY:
 // time ./galsim 05000 ../input_data/ellipse_N_05000.gal 100 0.00001 0.1 0 1
+//
+// Optional flags after the positional arguments:
+// --schedule costzone|dynamic|static   Work distribution (default costzone)
+// --pin                                Pin threads to CPUs (or GALSIM_PIN=1)
+// --replicate-tree                     Quadtree copy per socket, implies --pin
+// --chunk <size>                       Chunk size of --schedule dynamic
+// --autotune                           Pick threads, schedule, chunk size and
+//                                      layout
+// --autotune-cache <file>              Cache of --autotune (autotune.txt)
+// --output <file>                      Output file (result.gal)
+// --output-format gal|v2               Output as .gal records or galaxy v2
+// --snapshot <k>                       Write a trajectory frame every k steps
+// --snapshot-file <file>               Trajectory file (trajectory.galt)
+// --snapshot-encoding <e>              raw, delta or quantized (default raw)
+// --snapshot-error <e>                 Largest error with quantized (1e-6)
+// --checkpoint <k>                     Write a checkpoint every k steps
+// --checkpoint-file <file>             Checkpoint file (checkpoint.galc)
+// --restart <file>                     Continue from checkpoint, not input file,
+//                                      and the --snapshot trajectory from the
+//                                      end recorded in it
+// --capture <k>                        Write the state step k starts from, for
+//                                      galreplay (see replay.c)
+// --capture-file <file>                Capture file (capture.galcap)
+// --capture-tree                       Add the quadtree of step k to the capture
+// --generate <d>                       Generate the particles instead of reading
+//                                      the input file: uniform, plummer,
+//                                      exponential or collision
+// --galaxies <k>                       Galaxies of --generate collision (2)
+// --seed <s>                           Random seed of --generate (1)
+// --huge-pages on|off                  Transparent huge pages for particles
+//                                      and quadtree nodes (default on)
+// --memory-report                      Print huge page use and TLB misses
+// --layout soa|tiled                   Particle layout during the simulation,
+//                                      tiled groups TILE particles (soa)
+// --timing <file>                      Write the seconds of every phase, step
+//                                      and thread, as JSON if <file> ends in
+//                                      .json, else as CSV
+// --counters                           Add hardware counters of every phase
+//                                      and thread to the --timing report
+// --diagnostics <k>                    Measure energy and momenta every k
+//                                      steps, with their drift
+// --diagnostics-file <file>            Diagnostics file (diagnostics.csv)
+// --trace <file>                       Write a timeline of the phases of every
+//                                      thread as Chrome trace-event JSON
+//
+// Write generated initial conditions as a .gal file by running 0 steps:
+// ./galsim 100000 - 0 0.00001 0.1 0 4 --generate plummer --output plummer.gal
 
 // ./galsim 2 ../input_data/circles_N_2.gal 100 0.00001 0.1 0
 // ./galsim 4 ../input_data/circles_N_4.gal 100 0.00001 0.1 0
@@ -22,11 +69,21 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "modules.h"
 #include "graphics.h"
 #include "galsim.h"
 #include "io.h"
 #include "quadtree.h"
+#include "numa.h"
+#include "autotune.h"
+#include "generate.h"
+#include "memory.h"
+#include "timing.h"
+#include "trace.h"
+
+#define DEFAULT_CHUNK_SIZE 64 // Particles per chunk with --schedule dynamic
+#define TRACE_EVENTS_PER_STEP 16 // Trace buffer of every thread, per step
 
 /**
  * Main function
@@ -35,20 +92,206 @@
 int main(int argc, char const *argv[]) {
 
 	// Check proper number of input arguments
-	if (argc != 8) {
+	if (argc < 8) {
 		printf("%s\n", "Input error: Expected 7 input arguments");
 		return 1;
 	}
 
 	// Read input from command line
 	const char* program = argv[0];	// Used to return graphics errors
-	const int N = atoi(argv[1]); // Nr of stars to simulate
+	long N = atol(argv[1]); // Nr of stars to simulate, 0 takes it from v2 files
 	const char* filename = argv[2]; // Filename
 	const int nsteps = atoi(argv[3]); // Nr of filesteps
 	const double delta_t = atof(argv[4]); // Timestep
 	const double theta_max = atof(argv[5]);
 	const int graphics = atoi(argv[6]); // Graphics on/off as 1/0
-	const int n_threads = atoi(argv[7]); // Number of threads
+	int n_threads = atoi(argv[7]); // Number of threads, unless autotuned
+
+	// Read optional flags from command line
+	schedule_t schedule = SCHEDULE_COSTZONE;
+	layout_t layout = LAYOUT_SOA;
+	const char* pinEnv = getenv("GALSIM_PIN");
+	int pin = pinEnv && atoi(pinEnv);
+	int replicateTree = 0;
+	int chunkSize = DEFAULT_CHUNK_SIZE;
+	int tune = 0;
+	const char* tuneCache = "autotune.txt";
+	const char* outputFilename = "result.gal";
+	int outputGalaxy = 0;
+	int snapshotInterval = 0;
+	const char* snapshotFilename = "trajectory.galt";
+	int snapshotEncoding = SNAPSHOT_RAW;
+	double snapshotError = 1e-6;
+	int checkpointInterval = 0;
+	const char* checkpointFilename = "checkpoint.galc";
+	const char* restartFilename = NULL;
+	int captureStep = -1;
+	const char* captureFilename = "capture.galcap";
+	int captureTree = 0;
+	int generate = 0;
+	distribution_t distribution = DISTRIBUTION_UNIFORM;
+	int n_galaxies = 2;
+	unsigned long seed = 1;
+	int hugePages = 1;
+	int memoryReport = 0;
+	const char* timingFilename = NULL;
+	int counters = 0;
+	int diagnosticsInterval = 0;
+	const char* diagnosticsFilename = "diagnostics.csv";
+	const char* traceFilename = NULL;
+	int firstStep = 0;
+	long trajectoryEnd = 0; // Trajectory to continue after a restart
+	unsigned int i;
+	for (i = 8; i < argc; i++) {
+		if (!strcmp(argv[i], "--schedule") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "costzone")) {
+				schedule = SCHEDULE_COSTZONE;
+			} else if (!strcmp(argv[i], "dynamic")) {
+				schedule = SCHEDULE_DYNAMIC;
+			} else if (!strcmp(argv[i], "static")) {
+				schedule = SCHEDULE_STATIC;
+			} else {
+				printf("Input error: Unknown schedule %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--pin")) {
+			pin = 1;
+		} else if (!strcmp(argv[i], "--replicate-tree")) {
+			// Replicas only stay local if threads do not move
+			replicateTree = 1;
+			pin = 1;
+		} else if (!strcmp(argv[i], "--chunk") && i + 1 < argc) {
+			chunkSize = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--autotune")) {
+			tune = 1;
+		} else if (!strcmp(argv[i], "--autotune-cache") && i + 1 < argc) {
+			tuneCache = argv[++i];
+		} else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+			outputFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--output-format") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "gal")) {
+				outputGalaxy = 0;
+			} else if (!strcmp(argv[i], "v2")) {
+				outputGalaxy = 1;
+			} else {
+				printf("Input error: Unknown output format %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+			snapshotInterval = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--snapshot-file") && i + 1 < argc) {
+			snapshotFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--snapshot-encoding") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "raw")) {
+				snapshotEncoding = SNAPSHOT_RAW;
+			} else if (!strcmp(argv[i], "delta")) {
+				snapshotEncoding = SNAPSHOT_DELTA;
+			} else if (!strcmp(argv[i], "quantized")) {
+				snapshotEncoding = SNAPSHOT_QUANTIZED;
+			} else {
+				printf("Input error: Unknown snapshot encoding %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--snapshot-error") && i + 1 < argc) {
+			snapshotError = atof(argv[++i]);
+			if (!(snapshotError > 0)) {
+				printf("%s\n", "Input error: Snapshot error must be positive");
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--checkpoint") && i + 1 < argc) {
+			checkpointInterval = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--checkpoint-file") && i + 1 < argc) {
+			checkpointFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--restart") && i + 1 < argc) {
+			restartFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+			captureStep = atoi(argv[++i]);
+			if (captureStep < 0 || captureStep >= nsteps) {
+				printf("%s\n", "Input error: Capture step must be below nsteps");
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--capture-file") && i + 1 < argc) {
+			captureFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--capture-tree")) {
+			captureTree = 1;
+		} else if (!strcmp(argv[i], "--generate") && i + 1 < argc) {
+			generate = 1;
+			i++;
+			if (!strcmp(argv[i], "uniform")) {
+				distribution = DISTRIBUTION_UNIFORM;
+			} else if (!strcmp(argv[i], "plummer")) {
+				distribution = DISTRIBUTION_PLUMMER;
+			} else if (!strcmp(argv[i], "exponential")) {
+				distribution = DISTRIBUTION_EXPONENTIAL;
+			} else if (!strcmp(argv[i], "collision")) {
+				distribution = DISTRIBUTION_COLLISION;
+			} else {
+				printf("Input error: Unknown distribution %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--galaxies") && i + 1 < argc) {
+			n_galaxies = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--seed") && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 10);
+		} else if (!strcmp(argv[i], "--huge-pages") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "on")) {
+				hugePages = 1;
+			} else if (!strcmp(argv[i], "off")) {
+				hugePages = 0;
+			} else {
+				printf("Input error: Unknown huge pages setting %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--memory-report")) {
+			memoryReport = 1;
+		} else if (!strcmp(argv[i], "--timing") && i + 1 < argc) {
+			timingFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--counters")) {
+			counters = 1;
+		} else if (!strcmp(argv[i], "--diagnostics") && i + 1 < argc) {
+			diagnosticsInterval = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--diagnostics-file") && i + 1 < argc) {
+			diagnosticsFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			traceFilename = argv[++i];
+		} else if (!strcmp(argv[i], "--layout") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "soa")) {
+				layout = LAYOUT_SOA;
+			} else if (!strcmp(argv[i], "tiled")) {
+				layout = LAYOUT_TILED;
+			} else {
+				printf("Input error: Unknown layout %s\n", argv[i]);
+				return 1;
+			}
+		} else {
+			printf("Input error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (counters && !timingFilename) {
+		printf("%s\n", "Input error: --counters needs --timing");
+		return 1;
+	}
+
+	// Galaxy v2 input files know their N
+	const int galaxyInput = !restartFilename && !generate
+			&& isGalaxyFile(filename);
+	if (galaxyInput) {
+		galaxyHeader_t header;
+		if (readGalaxyHeader(&header, filename))
+			return 1;
+		if (N == 0) {
+			N = header.N;
+		} else if (N != header.N) {
+			printf("%s\n", "ERROR: Input file holds another N. Is N correct?");
+			return 1;
+		}
+	}
 
 	// Constants for the simulation
 	const double G = 100.0/N; // Gravitational constant
@@ -64,9 +307,21 @@ int main(int argc, char const *argv[]) {
 			(simulationConstants_t*) malloc(sizeof(simulationConstants_t));
 	simulationConstants->N = &N;
 	simulationConstants->nsteps = &nsteps;
+	simulationConstants->firstStep = &firstStep;
+	simulationConstants->checkpointInterval = &checkpointInterval;
+	simulationConstants->checkpointFilename = &checkpointFilename;
+	simulationConstants->captureStep = &captureStep;
+	simulationConstants->captureFilename = &captureFilename;
+	simulationConstants->captureTree = &captureTree;
 	simulationConstants->delta_t = &delta_t;
 	simulationConstants->theta_max = &theta_max;
 	simulationConstants->n_threads = &n_threads;
+	simulationConstants->schedule = &schedule;
+	simulationConstants->layout = &layout;
+	simulationConstants->chunkSize = &chunkSize;
+	simulationConstants->replicateTree = &replicateTree;
+	simulationConstants->hugePages = &hugePages;
+	simulationConstants->memoryReport = &memoryReport;
 	simulationConstants->G = &G;
 	simulationConstants->eps0 = &eps0;
 
@@ -78,47 +333,155 @@ int main(int argc, char const *argv[]) {
 	graphicsConstants->circleRadius = &circleRadius;
 	graphicsConstants->circleColour = &circleColour;
 
-	// Create particles struct and allocate space
+	// Pin threads before any memory is touched
+	if (pin) {
+		pinThreads(n_threads);
+	}
+
+	// Create particles struct
 	particles_t* particles = (particles_t*) malloc(sizeof(particles_t));
-	particles->x = (double*) malloc(N * sizeof(double));
-	particles->y = (double*) malloc(N * sizeof(double));
-	particles->v_x = (double*) malloc(N * sizeof(double));
-	particles->v_y = (double*) malloc(N * sizeof(double));
-	particles->mass = (double*) malloc(N * sizeof(double));
-	double* brightness = (double*) malloc(N * sizeof(double));
-
-	// Check malloc
-	if (!(particles && brightness)) {
-		// Program fail, exit
-		printf("ERROR: Malloc failure");
-		return 1;
+	double* brightness = NULL;
+	galaxyMap_t map = { NULL, 0 };
+	double readStart = wallTime();
+	if (galaxyInput) {
+		// Use the columns of the file in place
+		if (mapGalaxy(particles, &brightness, &map, filename))
+			return 1;
+	} else {
+		// Allocate space, all columns in one mapping
+		if (allocateParticles(particles, &brightness, N, hugePages)) {
+			// Program fail, exit
+			printf("ERROR: Malloc failure");
+			return 1;
+		}
+
+		// Place particle pages on the sockets of the threads using them
+		firstTouch(particles, brightness, N);
+		readStart = wallTime();
+
+		// Read data, or the state of an earlier run, or generate data
+		if (restartFilename) {
+			if (readCheckpoint(particles, brightness, simulationConstants,
+						&firstStep, &trajectoryEnd, restartFilename))
+				return 1;
+		} else if (generate) {
+			generateParticles(particles, brightness, N, G, eps0, distribution,
+					n_galaxies, seed);
+		} else {
+			if (readData(particles, brightness, filename, N))
+				return 1;
+		}
 	}
+	const double readSeconds = wallTime() - readStart;
 
-	// Read data
-	if (readData(particles, brightness, filename, N))
-		return 1;
+	// Pick the fastest configuration, and pin the threads it uses
+	if (tune) {
+		autotune(particles, simulationConstants,
+				&n_threads, &schedule, &chunkSize, &layout, tuneCache);
+		if (pin) {
+			pinThreads(n_threads);
+		}
+	}
+
+	// Time the phases of every timestep, if asked to
+	timing_t* timing = NULL;
+	if (timingFilename) {
+		timing = timingCreate(firstStep, nsteps, n_threads);
+		if (!timing) {
+			printf("ERROR: Malloc failure");
+			return 1;
+		}
+		timingAddOnce(timing, PHASE_READ, readSeconds);
+		if (counters && !timingCountersStart(timing)) {
+			printf("%s\n", "Counters: hardware counters unavailable");
+		}
+	}
 
 	// Simulate
 	if (graphics) {
 		// Simulate with graphics
 		simulateWithGraphics(particles, simulationConstants, graphicsConstants);
 	} else {
+		// Start writing snapshots in the background
+		snapshotWriter_t* snapshots = NULL;
+		if (snapshotInterval > 0) {
+			snapshots = snapshotOpen(snapshotFilename,
+					particles, brightness, N, snapshotInterval, firstStep,
+					snapshotEncoding, snapshotError, n_threads, trajectoryEnd);
+			if (!snapshots)
+				return 1;
+		}
+
+		// Measure conservation every diagnosticsInterval steps
+		diagnostics_t* diagnostics = NULL;
+		if (diagnosticsInterval > 0) {
+			diagnostics = diagnosticsOpen(diagnosticsFilename,
+					diagnosticsInterval);
+			if (!diagnostics)
+				return 1;
+		}
+
+		// Record the phases of every thread
+		if (traceFilename && traceOpen(traceFilename, n_threads,
+				TRACE_EVENTS_PER_STEP * (long) (nsteps - firstStep + 1)))
+			return 1;
+
 		// Simulate movement only (only calculations)
-		simulate(particles, simulationConstants);
+		int tlbCounters[n_threads];
+		if (memoryReport) {
+			countersOpen(COUNTER_DTLB_MISSES, n_threads, tlbCounters);
+		}
+		simulate(particles, brightness, simulationConstants, snapshots, timing,
+				diagnostics);
+		if (traceClose())
+			return 1;
+		if (diagnostics && diagnosticsClose(diagnostics))
+			return 1;
+		if (memoryReport) {
+			const size_t bytes = 6 * N * sizeof(double);
+			printf("Memory: particles %.1f of %.1f MB in huge pages\n",
+					galaxyInput ? 0.0 : hugePageBytes(particles->x, bytes) / 1e6,
+					bytes / 1e6);
+			const long long misses = countersClose(tlbCounters, n_threads);
+			if (misses >= 0) {
+				printf("Memory: %lld data TLB load misses\n", misses);
+			} else {
+				printf("%s\n", "Memory: data TLB load misses unavailable");
+			}
+		}
+
+		// Wait for the last snapshots
+		if (snapshots && snapshotClose(snapshots))
+			return 1;
 	}
 
 	// Write new state of particles to file
-	if (writeOutput(particles, brightness, N))
-		return 1;
+	const double writeStart = wallTime();
+	if (outputGalaxy) {
+		galaxyHeader_t header = { .N = N, .step = nsteps, .delta_t = delta_t,
+				.theta_max = theta_max, .G = G, .eps0 = eps0 };
+		if (writeGalaxy(particles, brightness, &header, outputFilename))
+			return 1;
+	} else {
+		if (writeOutput(particles, brightness, N, outputFilename))
+			return 1;
+	}
+	timingAddOnce(timing, PHASE_WRITE, wallTime() - writeStart);
+
+	// Report timing
+	if (timing) {
+		if (writeTiming(timing, timingFilename))
+			return 1;
+		timingFree(timing);
+	}
 
 	// Free memory
-	free(particles->x);
-	free(particles->y);
-	free(particles->v_x);
-	free(particles->v_y);
-	free(particles->mass);
+	if (galaxyInput) {
+		unmapGalaxy(&map);
+	} else {
+		freeParticles(particles, N);
+	}
 	free(particles);
-	free(brightness);
 	free(graphicsConstants);
 	free(simulationConstants);
 
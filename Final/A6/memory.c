@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include "memory.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static size_t roundToHuge(const size_t size);
+
+static size_t columnLength(const long N);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void* allocateHuge(const size_t size, const int hugePages) {
+
+	// Map one huge page too many, then cut the mapping down to an aligned one
+	const size_t length = roundToHuge(size);
+	char* mapping = (char*) mmap(NULL, length + HUGE_PAGE,
+			PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (mapping == MAP_FAILED) {
+		return NULL;
+	}
+	char* data = (char*) (((uintptr_t) mapping + HUGE_PAGE - 1)
+			& ~(HUGE_PAGE - 1));
+	if (data > mapping) {
+		munmap(mapping, data - mapping);
+	}
+	if (mapping + HUGE_PAGE > data) {
+		munmap(data + length, mapping + HUGE_PAGE - data);
+	}
+
+	// Only advice, so failure is not an error
+	madvise(data, length, hugePages ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+	return data;
+}
+
+void freeHuge(void* data, const size_t size) {
+
+	if (data) {
+		munmap(data, roundToHuge(size));
+	}
+}
+
+int allocateParticles(
+		particles_t* __restrict particles,
+		double** __restrict brightness,
+		const long N,
+		const int hugePages) {
+
+	const size_t length = columnLength(N);
+	double* data = (double*) allocateHuge(6 * length * sizeof(double),
+			hugePages);
+	if (!data) {
+		return 1;
+	}
+	particles->x = data;
+	particles->y = data + length;
+	particles->v_x = data + 2 * length;
+	particles->v_y = data + 3 * length;
+	particles->mass = data + 4 * length;
+	if (brightness) {
+		*brightness = data + 5 * length;
+	}
+
+	return 0;
+}
+
+void freeParticles(particles_t* particles, const long N) {
+
+	freeHuge(particles->x, 6 * columnLength(N) * sizeof(double));
+}
+
+long hugePageBytes(const void* data, const size_t size) {
+
+	FILE* fp = fopen("/proc/self/smaps", "r");
+	if (!fp) {
+		return -1;
+	}
+
+	// Sum AnonHugePages of every mapping overlapping the range
+	const uintptr_t first = (uintptr_t) data;
+	const uintptr_t last = first + size;
+	long bytes = 0;
+	long overlap = 0;
+	char line[256];
+	while (fgets(line, sizeof(line), fp)) {
+		unsigned long start, end;
+		long kB;
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			const uintptr_t lower = start > first ? start : first;
+			const uintptr_t upper = end < last ? end : last;
+			overlap = upper > lower ? upper - lower : 0;
+		} else if (sscanf(line, "AnonHugePages: %ld kB", &kB) == 1) {
+			bytes += 1024 * kB < overlap ? 1024 * kB : overlap;
+		}
+	}
+	fclose(fp);
+
+	return bytes;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static size_t roundToHuge(const size_t size) {
+
+	return (size + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+}
+
+/**
+ * Returns the doubles per particle column, N padded to PARTICLE_ALIGN bytes.
+ */
+static size_t columnLength(const long N) {
+
+	const size_t perLine = PARTICLE_ALIGN / sizeof(double);
+	return (N + perLine - 1) / perLine * perLine;
+}
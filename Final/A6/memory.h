@@ -0,0 +1,61 @@
+/**
+ *	memory.h
+ *	Contains functions for large, aligned, huge page backed allocations
+ *
+ *	The particle columns and the quadtree nodes are each kept in one mapping,
+ *	aligned to a huge page and advised for transparent huge pages, so a tree
+ *	walk over a large footprint needs fewer TLB entries. With huge pages off
+ *	the mappings are advised against them instead, to compare the two.
+ */
+
+#pragma once
+#include <stddef.h>
+#include "modules.h"
+
+#define HUGE_PAGE (2UL << 20) // Transparent huge page size
+#define PARTICLE_ALIGN 64 // Column alignment, one cache line and SIMD width
+
+/**
+ * Maps size bytes aligned to HUGE_PAGE. Pages are only backed by memory
+ * once touched.
+ *
+ * @param size      Bytes to map.
+ * @param hugePages Advise for transparent huge pages if 1, against if 0.
+ * @return          The mapping, or NULL on failure.
+ */
+void* allocateHuge(const size_t size, const int hugePages);
+
+/**
+ * Unmaps a mapping of allocateHuge().
+ *
+ * @param data The mapping.
+ * @param size Bytes passed to allocateHuge().
+ */
+void freeHuge(void* data, const size_t size);
+
+/**
+ * Allocates x, y, v_x, v_y, mass and brightness of N particles as columns
+ * of one mapping, each padded to PARTICLE_ALIGN bytes.
+ *
+ * @param particles  Set to the columns.
+ * @param brightness Set to the brightness column, unless NULL.
+ * @param N          The total number of particles.
+ * @param hugePages  Advise for transparent huge pages if 1, against if 0.
+ * @return           Returns 0 on success, else 1.
+ */
+int allocateParticles(
+		particles_t* __restrict particles,
+		double** __restrict brightness,
+		const long N,
+		const int hugePages);
+
+/**
+ * Frees the columns of allocateParticles().
+ */
+void freeParticles(particles_t* particles, const long N);
+
+/**
+ * Returns the bytes of [data, data + size) backed by huge pages, from
+ * /proc/self/smaps, or -1 if unknown.
+ */
+long hugePageBytes(const void* data, const size_t size);
@@ -1,5 +1,7 @@
 #pragma once
 
+#define TILE 8 // Particles per tile of LAYOUT_TILED
+
 // Contains arrays with information about each particle
 typedef struct particles {
 	double* x;
@@ -9,6 +11,21 @@ typedef struct particles {
 	double* mass;
 } particles_t;
 
+// TILE particles with every field contiguous, 64-byte aligned fields
+typedef struct particleTile {
+	double x[TILE];
+	double y[TILE];
+	double v_x[TILE];
+	double v_y[TILE];
+	double mass[TILE];
+} particleTile_t;
+
+// Particle layout during the simulation
+typedef enum layout {
+	LAYOUT_SOA, // particles_t, a stream per field
+	LAYOUT_TILED // particleTile_t, array of structures of arrays
+} layout_t;
+
 // Quadtree node
 typedef struct node {
 	// [0] == childNorthWest, [1] == childNorthEast,
@@ -27,15 +44,43 @@ typedef struct node {
 
 } node_t;
 
+// Nodes of a quadtree taken from one allocation, four children at a time
+typedef struct nodePool {
+	node_t* nodes;
+	long capacity; // Nr of nodes
+	long used;
+	int overflowed; // Ran out during the last build, children were malloc'd
+	int hugePages; // Advise for transparent huge pages
+} nodePool_t;
+
+// Work distribution of the force loop between threads
+typedef enum schedule {
+	SCHEDULE_COSTZONE, // Contiguous zones of equal interaction count
+	SCHEDULE_DYNAMIC, // Threads claim chunks of particles on demand
+	SCHEDULE_STATIC // Contiguous zones of equal particle count
+} schedule_t;
+
 // Input constants
 typedef struct simulationConstants {
 	const double* delta_t; // Timestep
 	const double* theta_max;
 	const double* G; // Gravitational constant
 	const double* eps0; // Plummer sphere constant
-	const int* N; // Nr of stars to simulate
+	const long* N; // Nr of stars to simulate
 	const int* nsteps; // Nr of filesteps
+	const int* firstStep; // Timestep to start from, nonzero after restart
 	const int* n_threads;
+	const schedule_t* schedule;
+	const layout_t* layout;
+	const int* chunkSize; // Particles per chunk with SCHEDULE_DYNAMIC
+	const int* replicateTree; // Copy of quadtree per socket on/off as 1/0
+	const int* hugePages; // Transparent huge pages on/off as 1/0
+	const int* memoryReport; // Print huge page use on/off as 1/0
+	const int* checkpointInterval; // Timesteps between checkpoints, 0 if off
+	const char** checkpointFilename;
+	const int* captureStep; // Timestep to capture, -1 if off
+	const char** captureFilename;
+	const int* captureTree; // Add the quadtree to the capture on/off as 1/0
 } simulationConstants_t;
 
 // Graphics constants
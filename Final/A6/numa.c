@@ -0,0 +1,135 @@
+#define _GNU_SOURCE
+#include "numa.h"
+#include <sched.h>
+#include <stdio.h>
+#include <string.h>
+#include <omp.h>
+
+// CPUs the process may use, saved before the first thread is pinned
+static cpu_set_t processCpus;
+static int savedCpus = 0;
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static int socketOfCpu(const int cpu);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void pinThreads(const int n_threads) {
+
+	// CPUs the process may use, not those of an already pinned thread
+	if (!savedCpus) {
+		if (sched_getaffinity(0, sizeof(cpu_set_t), &processCpus)) {
+			printf("%s\n",
+					"WARNING: Failed to get CPU affinity, threads not pinned");
+			return;
+		}
+		savedCpus = 1;
+	}
+	const cpu_set_t allowed = processCpus;
+	const int n_cpus = CPU_COUNT(&allowed);
+
+	#pragma omp parallel num_threads(n_threads)
+	{
+		// Find the allowed CPU of this thread, wrapping if too few
+		const int thread = omp_get_thread_num();
+		int skip = thread % n_cpus;
+		int cpu;
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &allowed) && skip-- == 0) {
+				break;
+			}
+		}
+
+		// Pin this thread
+		cpu_set_t pin;
+		CPU_ZERO(&pin);
+		CPU_SET(cpu, &pin);
+		if (sched_setaffinity(0, sizeof(cpu_set_t), &pin)) {
+			printf("WARNING: Failed to pin thread %d to CPU %d\n", thread, cpu);
+		}
+	}
+}
+
+void unpinThread(void) {
+
+	if (savedCpus) {
+		sched_setaffinity(0, sizeof(cpu_set_t), &processCpus);
+	}
+}
+
+void firstTouch(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N) {
+
+	// Same static distribution as the force loop to begin with
+	long i;
+	#pragma omp parallel for schedule(static)
+	for (i = 0; i < N; i++) {
+		particles->x[i] = 0.0;
+		particles->y[i] = 0.0;
+		particles->v_x[i] = 0.0;
+		particles->v_y[i] = 0.0;
+		particles->mass[i] = 0.0;
+		brightness[i] = 0.0;
+	}
+}
+
+int findThreadSockets(const int n_threads, int* socketOfThread) {
+
+	// Physical socket of every thread
+	int physical[n_threads];
+	#pragma omp parallel num_threads(n_threads)
+	{
+		physical[omp_get_thread_num()] = socketOfCpu(sched_getcpu());
+	}
+
+	// Number the sockets densely in order of first appearance
+	int seen[n_threads];
+	int n_sockets = 0;
+	unsigned int i;
+	unsigned int j;
+	for (i = 0; i < n_threads; i++) {
+		for (j = 0; j < n_sockets && seen[j] != physical[i]; j++);
+		if (j == n_sockets) {
+			seen[n_sockets++] = physical[i];
+		}
+		socketOfThread[i] = j;
+	}
+
+	return n_sockets;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Finds the physical socket of a CPU from sysfs.
+ *
+ * @param cpu CPU number
+ * @return    Socket number, 0 if unknown
+ */
+static int socketOfCpu(const int cpu) {
+
+	char path[128];
+	snprintf(path, sizeof(path),
+			"/sys/devices/system/cpu/cpu%d/topology/physical_package_id", cpu);
+
+	FILE* fp = fopen(path, "r");
+	if (!fp) {
+		return 0;
+	}
+	int socket;
+	if (fscanf(fp, "%d", &socket) != 1) {
+		socket = 0;
+	}
+	fclose(fp);
+
+	return socket;
+}
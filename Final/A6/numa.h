@@ -0,0 +1,48 @@
+/**
+ *	numa.h
+ *	Contains functions for thread pinning and NUMA-aware memory placement
+ *
+ */
+
+#pragma once
+#include "modules.h"
+
+/**
+ * Pins every OpenMP thread to its own CPU, taken in order from the CPUs the
+ * process is allowed to run on. Thread t is pinned to the t-th allowed CPU.
+ *
+ * @param n_threads Number of threads to pin.
+ */
+void pinThreads(const int n_threads);
+
+/**
+ * Lets the calling thread run on every CPU the process could use before
+ * pinThreads(), for threads other than the OpenMP threads, which would
+ * otherwise inherit the CPU of the thread creating them. Does nothing if no
+ * thread was pinned.
+ */
+void unpinThread(void);
+
+/**
+ * Touches the particle arrays from the threads that will later work on them,
+ * so that each memory page is placed on the socket of the thread using it.
+ * Must be called before anything else writes to the arrays.
+ *
+ * @param particles  Information about every particle.
+ * @param brightness Array with brightness information about every particle.
+ * @param N          The total number of particles.
+ */
+void firstTouch(
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N);
+
+/**
+ * Finds the socket every thread currently runs on. Sockets are numbered
+ * 0, 1, ... in order of first appearance. Only stable if threads are pinned.
+ *
+ * @param n_threads       Number of threads.
+ * @param socketOfThread  Array of n_threads, filled with the socket numbers.
+ * @return                The number of different sockets used.
+ */
+int findThreadSockets(const int n_threads, int* socketOfThread);
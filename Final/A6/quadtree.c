@@ -1,6 +1,12 @@
 #include "quadtree.h"
+#include "memory.h"
+#include "stats.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
+
+#define POOL_NODES_PER_PARTICLE 4 // Initial pool size, grows if too small
+#define POOL_MIN_NODES 1024
 
 /*******************************************************************************
   STATIC FUNCTION DECLARATIONS
@@ -10,9 +16,14 @@ static inline void insert(
 		node_t* __restrict node,
 		double x,
 		double y,
-		double mass);
+		double mass,
+		nodePool_t* __restrict pool);
+
+static void subdivide(node_t* node, nodePool_t* pool);
+
+static node_t* takeChildren(nodePool_t* pool);
 
-static void subdivide(node_t* node);
+static long freeOverflow(node_t* node, const nodePool_t* pool);
 
 static node_t* findCorrectChildForParticle(
 		node_t* node,
@@ -29,16 +40,44 @@ static void initialize(
 
 void buildQuadtree(
 		particles_t* __restrict particles,
-		const int N,
-		node_t* __restrict root) {
+		const long N,
+		node_t* __restrict root,
+		nodePool_t* __restrict pool) {
 
 	// Initialize Root node
 	initialize(root, 0.5, 0.5, 0.5);
 
-	unsigned int i;
+	long i;
+	for (i = 0; i < N; i++) {
+		insert(root, particles->x[i], particles->y[i], particles->mass[i],
+				pool);
+	}
+
+	#ifdef TREE_STATS
+	countTree(root);
+	#endif
+}
+
+void buildQuadtreeTiled(
+		const particleTile_t* __restrict tiles,
+		const long N,
+		node_t* __restrict root,
+		nodePool_t* __restrict pool) {
+
+	// Initialize Root node
+	initialize(root, 0.5, 0.5, 0.5);
+
+	// Same order as buildQuadtree(), so the quadtree is the same
+	long i;
 	for (i = 0; i < N; i++) {
-		insert(root, particles->x[i], particles->y[i], particles->mass[i]);
+		const particleTile_t* tile = tiles + i / TILE;
+		insert(root, tile->x[i % TILE], tile->y[i % TILE],
+				tile->mass[i % TILE], pool);
 	}
+
+	#ifdef TREE_STATS
+	countTree(root);
+	#endif
 }
 
 void freeQuadtree(node_t* node) {
@@ -52,6 +91,188 @@ void freeQuadtree(node_t* node) {
 	}
 }
 
+void releaseQuadtree(node_t* __restrict root, nodePool_t* __restrict pool) {
+
+	// Children outside the pool were malloc'd after it ran out
+	if (pool->overflowed) {
+		const long needed = pool->capacity + freeOverflow(root, pool);
+		freeNodePool(pool);
+		pool->capacity = 2 * needed;
+		pool->nodes = (node_t*) allocateHuge(pool->capacity * sizeof(node_t),
+				pool->hugePages);
+		if (!pool->nodes) {
+			pool->capacity = 0;
+		}
+	}
+	pool->used = 0;
+	pool->overflowed = 0;
+}
+
+int createNodePool(nodePool_t* pool, const long N, const int hugePages) {
+
+	pool->capacity = POOL_NODES_PER_PARTICLE * N + POOL_MIN_NODES;
+	pool->used = 0;
+	pool->overflowed = 0;
+	pool->hugePages = hugePages;
+	pool->nodes = (node_t*) allocateHuge(pool->capacity * sizeof(node_t),
+			hugePages);
+	if (!pool->nodes) {
+		pool->capacity = 0;
+		return 1;
+	}
+
+	return 0;
+}
+
+void freeNodePool(nodePool_t* pool) {
+
+	freeHuge(pool->nodes, pool->capacity * sizeof(node_t));
+	pool->nodes = NULL;
+	pool->capacity = 0;
+}
+
+void copyQuadtree(
+		const node_t* __restrict src,
+		node_t* __restrict dst) {
+
+	*dst = *src;
+	if (src->children) {
+		dst->children = (node_t*) malloc(4 * sizeof(node_t));
+		unsigned int i;
+		for (i = 0; i < 4; i++) {
+			copyQuadtree(src->children+i, dst->children+i);
+		}
+	}
+}
+
+// Calculates force exerted on every particle, recursively
+void calculateForces(
+		const double x,
+		const double y,
+		node_t* __restrict node,
+		const double G,
+		const double eps0,
+		const double delta_t,
+		const double theta_max,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		unsigned int* __restrict interactions) {
+
+	// Get distance particle<->box
+	double r_x = x - node->xCenterOfMass;
+	double r_y = y - node->yCenterOfMass;
+	double r = sqrt(r_x*r_x + r_y*r_y);
+	#ifdef TREE_STATS
+	threadTraversal.visited++;
+	#endif
+
+	// Check if box has children, then theta
+	if (node->children &&
+			(node->sideHalf + node->sideHalf) > theta_max * r)  {
+		#ifdef TREE_STATS
+		threadTraversal.opened++;
+		#endif
+
+		// Travel branch
+		unsigned int i;
+		for(i = 0; i < 4; i++) {
+			calculateForces(
+					x, y,
+					node->children + i,
+					G, eps0, delta_t, theta_max,
+					a_x, a_y, interactions);
+		}
+	} else {
+		// Calculate denominator
+		double denom = r + eps0;
+		denom = 1/(denom*denom*denom);
+		// Acceleration
+		*a_x += node->mass * r_x * denom;
+		*a_y += node->mass * r_y * denom;
+		(*interactions)++;
+	}
+}
+
+void calculateForcesAndPotential(
+		const double x,
+		const double y,
+		node_t* __restrict node,
+		const double G,
+		const double eps0,
+		const double delta_t,
+		const double theta_max,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		double* __restrict phi,
+		unsigned int* __restrict interactions) {
+
+	// Get distance particle<->box
+	double r_x = x - node->xCenterOfMass;
+	double r_y = y - node->yCenterOfMass;
+	double r = sqrt(r_x*r_x + r_y*r_y);
+	#ifdef TREE_STATS
+	threadTraversal.visited++;
+	#endif
+
+	// Check if box has children, then theta
+	if (node->children &&
+			(node->sideHalf + node->sideHalf) > theta_max * r)  {
+		#ifdef TREE_STATS
+		threadTraversal.opened++;
+		#endif
+
+		// Travel branch
+		unsigned int i;
+		for(i = 0; i < 4; i++) {
+			calculateForcesAndPotential(
+					x, y,
+					node->children + i,
+					G, eps0, delta_t, theta_max,
+					a_x, a_y, phi, interactions);
+		}
+	} else {
+		// Calculate denominator
+		double denom = r + eps0;
+		const double potential = (r + r + eps0) / (2 * denom * denom);
+		denom = 1/(denom*denom*denom);
+		// Acceleration
+		*a_x += node->mass * r_x * denom;
+		*a_y += node->mass * r_y * denom;
+		if (r > 0.0) {
+			*phi -= node->mass * potential;
+		}
+		(*interactions)++;
+	}
+}
+
+void computeCostZones(
+		const unsigned int* __restrict interactions,
+		const long N,
+		const int n_zones,
+		long* __restrict zoneStart) {
+
+	// Total cost of the last step
+	unsigned long total = 0;
+	long i;
+	for (i = 0; i < N; i++) {
+		total += interactions[i];
+	}
+
+	// Close a zone every time the running cost passes its share
+	unsigned long cost = 0;
+	unsigned int zone = 1;
+	zoneStart[0] = 0;
+	for (i = 0; i < N; i++) {
+		cost += interactions[i];
+		while (zone < n_zones && cost * n_zones >= total * zone) {
+			zoneStart[zone++] = i + 1;
+		}
+	}
+	while (zone <= n_zones) {
+		zoneStart[zone++] = N;
+	}
+}
+
 /*******************************************************************************
   STATIC FUNCTION DEFINITIONS
  ******************************************************************************/
@@ -63,17 +284,19 @@ void freeQuadtree(node_t* node) {
  * @param x			Particle x-coordinate
  * @param y			Particle y-coordinate
  * @param mass		Particle mass
+ * @param pool		Pool to take new nodes from, or NULL
  */
 static inline void insert(
 		node_t* __restrict node,
 		double x,
 		double y,
-		double mass) {
+		double mass,
+		nodePool_t* __restrict pool) {
 
 	if(node->children) {
 		// If node has children -> is interior -> recurse on child
 		insert(findCorrectChildForParticle(node, x, y),
-				x, y, mass);
+				x, y, mass, pool);
 
 		// Update center of mass and mass of node due to new particle
 		const double newMass = node->mass + mass;
@@ -87,16 +310,16 @@ static inline void insert(
 
 		if(node->mass) {
 			// If leaf is already occupied -> subdivide
-			subdivide(node);
+			subdivide(node, pool);
 
 			// Then, move input to appropriate child
 			insert(findCorrectChildForParticle(node, x, y),
-					x, y, mass);
+					x, y, mass, pool);
 			// Then, move node values to appropriate child
 			insert(findCorrectChildForParticle(node,
 						node->xCenterOfMass,
 						node->yCenterOfMass),
-					node->xCenterOfMass, node->yCenterOfMass, node->mass);
+					node->xCenterOfMass, node->yCenterOfMass, node->mass, pool);
 
 			// Update center of mass and mass of node due to new particle
 			const double newMass = node->mass + mass;
@@ -119,11 +342,12 @@ static inline void insert(
  * Subdivides this node (makes it an interior node) by giving it four children.
  *
  * @param node Node of quadtree
+ * @param pool Pool to take the children from, or NULL
  */
-static inline void subdivide(node_t* node) {
+static inline void subdivide(node_t* node, nodePool_t* pool) {
 
 	// Allocate children
-	node_t* children = (node_t*) malloc(4 * sizeof(node_t));
+	node_t* children = takeChildren(pool);
 	node->children = children;
 
 	// Calculate side length and all centers beforehand
@@ -156,6 +380,48 @@ static inline void subdivide(node_t* node) {
 			sideQuarter);
 }
 
+/**
+ * Returns four nodes from pool, or malloc'd if there is no pool or it has
+ * run out.
+ */
+static node_t* takeChildren(nodePool_t* pool) {
+
+	if (pool && pool->used + 4 <= pool->capacity) {
+		node_t* children = pool->nodes + pool->used;
+		pool->used += 4;
+		return children;
+	}
+	if (pool) {
+		pool->overflowed = 1;
+	}
+
+	return (node_t*) malloc(4 * sizeof(node_t));
+}
+
+/**
+ * Frees the children below node that are not in pool, and returns their
+ * number.
+ */
+static long freeOverflow(node_t* node, const nodePool_t* pool) {
+
+	if (!node->children) {
+		return 0;
+	}
+
+	long freed = 0;
+	unsigned int i;
+	for (i = 0; i < 4; i++) {
+		freed += freeOverflow(node->children + i, pool);
+	}
+	if (node->children < pool->nodes
+			|| node->children >= pool->nodes + pool->capacity) {
+		free(node->children);
+		freed += 4;
+	}
+
+	return freed;
+}
+
 /**
  * Finds the child of @param node where @param particle shall be inserted.
  *
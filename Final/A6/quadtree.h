@@ -13,11 +13,28 @@
  * @param particles	Array of particles
  * @param N			Total number of particles
  * @param root		Root node of quadtree
+ * @param pool		Pool to take the nodes from, or NULL to malloc them
  */
 void buildQuadtree(
 		particles_t* __restrict particles,
-		const int N,
-		node_t* __restrict root);
+		const long N,
+		node_t* __restrict root,
+		nodePool_t* __restrict pool);
+
+/**
+ * Builds a quadtree of size N from a root node, and fills it with tiled
+ * particles
+ *
+ * @param tiles		Tiles of particles, TILE per tile
+ * @param N			Total number of particles
+ * @param root		Root node of quadtree
+ * @param pool		Pool to take the nodes from, or NULL to malloc them
+ */
+void buildQuadtreeTiled(
+		const particleTile_t* __restrict tiles,
+		const long N,
+		node_t* __restrict root,
+		nodePool_t* __restrict pool);
 
 /**
  * Frees every sub-node of node in quadtree
@@ -25,3 +42,107 @@ void buildQuadtree(
  * @param node Node of quadtree
  */
 void freeQuadtree(node_t* node);
+
+/**
+ * Frees a quadtree built from pool, and empties the pool. If the pool ran
+ * out, it grows to fit the next quadtree.
+ *
+ * @param root Root node of quadtree
+ * @param pool Pool the quadtree was built from
+ */
+void releaseQuadtree(node_t* __restrict root, nodePool_t* __restrict pool);
+
+/**
+ * Creates a pool of nodes sized for a quadtree of N particles, in one
+ * allocation aligned to a huge page.
+ *
+ * @param pool		Pool to create
+ * @param N			Total number of particles
+ * @param hugePages	Advise for transparent huge pages if 1, against if 0
+ * @return			Returns 0 on success, else 1
+ */
+int createNodePool(nodePool_t* pool, const long N, const int hugePages);
+
+/**
+ * Unmaps the nodes of a pool made by createNodePool and leaves the pool
+ * empty, with no nodes and a capacity of 0.
+ *
+ * @param pool		Pool to free
+ */
+void freeNodePool(nodePool_t* pool);
+
+/**
+ * Copies the quadtree below src into dst. The new nodes are allocated by the
+ * calling thread, so they are placed in memory close to it.
+ *
+ * @param src Root node of quadtree to copy
+ * @param dst Root node of the copy
+ */
+void copyQuadtree(
+		const node_t* __restrict src,
+		node_t* __restrict dst);
+
+/**
+ * Adds the acceleration from the particles below node to a particle at
+ * (x, y), walking the quadtree recursively. A node is opened if it has
+ * children and its side is larger than theta_max times its distance.
+ *
+ * @param x				Particle x-coordinate
+ * @param y				Particle y-coordinate
+ * @param node			Node of quadtree (call function using root)
+ * @param G				Gravitational constant
+ * @param eps0			Plummer sphere constant
+ * @param delta_t		Timestep
+ * @param theta_max		Opening criterion
+ * @param a_x			Acceleration in x, added to
+ * @param a_y			Acceleration in y, added to
+ * @param interactions	Number of particle-node interactions, added to
+ */
+void calculateForces(
+		const double x,
+		const double y,
+		node_t* __restrict node,
+		const double G,
+		const double eps0,
+		const double delta_t,
+		const double theta_max,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		unsigned int* __restrict interactions);
+
+/**
+ * As calculateForces(), and also adds the potential per unit mass, without
+ * G, of every interaction. The potential is that of the softened force,
+ * -(2r + eps0) / (2(r + eps0)^2) per unit mass at distance r. Leaves at the
+ * particle itself add none.
+ *
+ * @param phi			Potential, added to
+ */
+void calculateForcesAndPotential(
+		const double x,
+		const double y,
+		node_t* __restrict node,
+		const double G,
+		const double eps0,
+		const double delta_t,
+		const double theta_max,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		double* __restrict phi,
+		unsigned int* __restrict interactions);
+
+/**
+ * Splits particles 0 to N - 1 into n_zones contiguous zones of roughly equal
+ * total interactions, so threads walking one zone each do equal work. Zone z
+ * covers particles zoneStart[z] to zoneStart[z + 1] - 1.
+ *
+ * @param interactions	Interactions of every particle last timestep
+ * @param N				Number of particles
+ * @param n_zones		Number of zones
+ * @param zoneStart		First particle of every zone, n_zones + 1 entries
+ */
+void computeCostZones(
+		const unsigned int* __restrict interactions,
+		const long N,
+		const int n_zones,
+		long* __restrict zoneStart);
@@ -0,0 +1,486 @@
+// RUN BY:
+// ./galsim 100000 - 200 0.00001 0.5 0 4 --generate collision --capture 150 --capture-tree
+// make galreplay
+// ./galreplay capture.galcap --phase force --threads 1,2,4 --schedule costzone,dynamic --reps 20
+//
+// Optional flags after the capture file, lists are comma separated:
+// --phase build|force|both     Phase to replay (both)
+// --reps <k>                   Timed repetitions of every variant (10)
+// --warmup <k>                 Untimed repetitions before them (1)
+// --threads <list>             Thread counts of the force phase (1, 2, 4, ...
+//                              and the processors)
+// --schedule <list>            costzone, dynamic or static (costzone)
+// --chunk <size>               Chunk size of --schedule dynamic (64)
+// --theta <list>               theta_max of the force walk (the captured one)
+// --nodes <list>               Quadtree nodes of the build from a pool or
+//                              malloc'd (pool)
+// --tree captured|rebuilt      Quadtree walked by the force phase (captured,
+//                              if the capture holds one)
+// --output <file>              CSV file (stdout)
+//
+// CSV columns: phase, step, N, nodes, schedule, theta, threads, reps, min,
+// median, mean and standard deviation of the seconds, interactions, load
+// imbalance of the threads and a checksum of the accelerations. The build
+// runs on one thread, as in the simulation.
+
+/**
+ * Replays the quadtree build or the force walk of a timestep captured by
+ * galsim --capture, repeated on the same state, so every repetition and
+ * every run does exactly the same work. The force walk sets accelerations
+ * only and leaves the particles as captured; the update after it streams
+ * through the particles once and is timed by galbench. The cost zones are
+ * split by the interactions of the captured timestep's previous timestep,
+ * as in the simulation.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <omp.h>
+#include "modules.h"
+#include "quadtree.h"
+#include "capture.h"
+#include "timing.h"
+#include "tools.h"
+
+#define MAX_LIST 32 // Longest list of a flag
+#define DEFAULT_CHUNK_SIZE 64 // Particles per chunk with --schedule dynamic
+
+static const char* scheduleNames[] = { "costzone", "dynamic", "static" };
+static const char* nodeNames[] = { "pool", "malloc" };
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static int parseNames(
+		const char* text,
+		const char** names,
+		const int n_names,
+		int* use);
+
+static double replayForce(
+		const capture_t* __restrict capture,
+		node_t* __restrict root,
+		const double theta_max,
+		const int threads,
+		const schedule_t schedule,
+		const int chunkSize,
+		const long* __restrict zoneStart,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		unsigned int* __restrict interactions,
+		double* __restrict imbalance);
+
+static void writeRow(
+		FILE* fp,
+		const char* phase,
+		const capture_t* capture,
+		const char* nodes,
+		const char* schedule,
+		const double theta_max,
+		const int threads,
+		double* seconds,
+		const int reps,
+		const unsigned long interactions,
+		const double imbalance,
+		const double checksum);
+
+/*******************************************************************************
+  FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Main function
+ *
+ */
+int main(int argc, char const *argv[]) {
+
+	if (argc < 2) {
+		printf("Usage: %s capture [--phase build|force|both] [--reps k] "
+				"[--threads list] [--schedule list] [--theta list] ...\n",
+				argv[0]);
+		return 1;
+	}
+
+	// Defaults
+	int replayBuild = 1;
+	int replayForces = 1;
+	int reps = 10;
+	int warmup = 1;
+	double threadCounts[MAX_LIST];
+	int n_threadCounts = 0;
+	const int n_procs = omp_get_num_procs();
+	int threads;
+	for (threads = 1; threads < n_procs && n_threadCounts < MAX_LIST - 1;
+			threads *= 2) {
+		threadCounts[n_threadCounts++] = threads;
+	}
+	threadCounts[n_threadCounts++] = n_procs;
+	int useSchedule[3] = { 1, 0, 0 };
+	int chunkSize = DEFAULT_CHUNK_SIZE;
+	double thetas[MAX_LIST];
+	int n_thetas = 0;
+	int useNodes[2] = { 1, 0 };
+	int rebuildTree = 0;
+	const char* outputFilename = NULL;
+
+	// Read optional flags from command line
+	unsigned int i;
+	for (i = 2; i < argc; i++) {
+		if (!strcmp(argv[i], "--phase") && i + 1 < argc) {
+			i++;
+			replayBuild = !strcmp(argv[i], "build") || !strcmp(argv[i], "both");
+			replayForces = !strcmp(argv[i], "force") || !strcmp(argv[i], "both");
+			if (!replayBuild && !replayForces) {
+				printf("Input error: Unknown phase %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--reps") && i + 1 < argc) {
+			reps = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+			n_threadCounts = parseCheckedList(argv[++i], threadCounts,
+					MAX_LIST, 1, 1);
+		} else if (!strcmp(argv[i], "--schedule") && i + 1 < argc) {
+			if (parseNames(argv[++i], scheduleNames, 3, useSchedule)) {
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--chunk") && i + 1 < argc) {
+			chunkSize = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--theta") && i + 1 < argc) {
+			n_thetas = parseCheckedList(argv[++i], thetas, MAX_LIST, 0, 0);
+			if (n_thetas < 1) {
+				printf("%s\n", "Input error: Empty or invalid list");
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--nodes") && i + 1 < argc) {
+			if (parseNames(argv[++i], nodeNames, 2, useNodes)) {
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--tree") && i + 1 < argc) {
+			i++;
+			if (!strcmp(argv[i], "captured")) {
+				rebuildTree = 0;
+			} else if (!strcmp(argv[i], "rebuilt")) {
+				rebuildTree = 1;
+			} else {
+				printf("Input error: Unknown tree %s\n", argv[i]);
+				return 1;
+			}
+		} else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+			outputFilename = argv[++i];
+		} else {
+			printf("Input error: Unknown option %s\n", argv[i]);
+			return 1;
+		}
+	}
+	if (n_threadCounts < 1 || reps < 1 || warmup < 0 || chunkSize < 1) {
+		printf("%s\n", "Input error: Empty or invalid list, no repetitions or no chunk");
+		return 1;
+	}
+
+	// Captured timestep
+	capture_t capture;
+	if (readCapture(&capture, argv[1])) {
+		return 1;
+	}
+	const long N = capture.N;
+	if (n_thetas == 0) {
+		thetas[n_thetas++] = capture.theta_max;
+	}
+	printf("Replay: step %d of %ld particles, theta_max %g, quadtree %s\n",
+			capture.step, N, capture.theta_max,
+			capture.n_nodes ? "captured" : "not captured");
+
+	FILE* fp = outputFilename ? fopen(outputFilename, "w") : stdout;
+	if (!fp) {
+		printf("%s\n", "ERROR: Failed to open output file.");
+		freeCapture(&capture);
+		return 1;
+	}
+	fprintf(fp, "phase,step,N,nodes,schedule,theta,threads,reps,min_s,"
+			"median_s,mean_s,stddev_s,interactions,imbalance,checksum\n");
+
+	// Quadtree build, one thread, with every node allocation
+	double seconds[reps];
+	int rep;
+	unsigned int v;
+	for (v = 0; v < 2 && replayBuild; v++) {
+		if (!useNodes[v]) {
+			continue;
+		}
+		nodePool_t pool;
+		if (v == 0 && createNodePool(&pool, N, 1)) {
+			printf("ERROR: Malloc failure");
+			return 1;
+		}
+		node_t root;
+		int same = 1;
+		for (rep = -warmup; rep < reps; rep++) {
+			const double start = wallTime();
+			buildQuadtree(&capture.particles, N, &root, v == 0 ? &pool : NULL);
+			const double stop = wallTime();
+
+			// The build must give the captured quadtree
+			if (capture.n_nodes && rep == reps - 1) {
+				same = sameQuadtree(&root, &capture.root);
+			}
+			if (v == 0) {
+				releaseQuadtree(&root, &pool);
+			} else {
+				freeQuadtree(&root);
+			}
+			if (rep >= 0) {
+				seconds[rep] = stop - start;
+			}
+		}
+		if (v == 0) {
+			freeNodePool(&pool);
+		}
+		if (!same) {
+			printf("%s\n", "WARNING: Build differs from the captured quadtree");
+		}
+		writeRow(fp, "build", &capture, nodeNames[v], NULL, -1.0, 1,
+				seconds, reps, 0, -1.0, -1.0);
+	}
+
+	// Force walk of the captured quadtree, unless rebuilt
+	if (replayForces) {
+		node_t rebuilt;
+		node_t* root = &capture.root;
+		if (rebuildTree || !capture.n_nodes) {
+			buildQuadtree(&capture.particles, N, &rebuilt, NULL);
+			root = &rebuilt;
+		}
+		double* a_x = (double*) malloc(N * sizeof(double));
+		double* a_y = (double*) malloc(N * sizeof(double));
+		unsigned int* interactions =
+				(unsigned int*) malloc(N * sizeof(unsigned int));
+		if (!(a_x && a_y && interactions)) {
+			printf("ERROR: Malloc failure");
+			return 1;
+		}
+
+		unsigned int t;
+		for (t = 0; t < n_threadCounts; t++) {
+			threads = (int) threadCounts[t];
+			long zoneStart[threads + 1];
+			computeCostZones(capture.interactions, N, threads, zoneStart);
+
+			unsigned int s;
+			for (s = 0; s < 3; s++) {
+				if (!useSchedule[s]) {
+					continue;
+				}
+				unsigned int k;
+				for (k = 0; k < n_thetas; k++) {
+					double imbalance = 0.0;
+					for (rep = -warmup; rep < reps; rep++) {
+						double repImbalance;
+						const double time = replayForce(&capture, root,
+								thetas[k], threads, (schedule_t) s, chunkSize,
+								zoneStart, a_x, a_y, interactions,
+								&repImbalance);
+						if (rep >= 0) {
+							seconds[rep] = time;
+							imbalance += repImbalance / reps;
+						}
+					}
+
+					// Same for every schedule and thread count, unless the
+					// walk changed
+					unsigned long total = 0;
+					double checksum = 0.0;
+					long j;
+					for (j = 0; j < N; j++) {
+						total += interactions[j];
+						checksum += fabs(a_x[j]) + fabs(a_y[j]);
+					}
+					writeRow(fp, "force", &capture, NULL, scheduleNames[s],
+							thetas[k], threads, seconds, reps, total,
+							imbalance, checksum);
+				}
+			}
+		}
+
+		if (root == &rebuilt) {
+			freeQuadtree(&rebuilt);
+		}
+		free(a_x);
+		free(a_y);
+		free(interactions);
+	}
+
+	freeCapture(&capture);
+	if (fp != stdout && fclose(fp)) {
+		printf("%s\n", "ERROR: Failed to write output file.");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Sets use[k] to 1 for every name in the comma separated list text, and to 0
+ * for the others.
+ *
+ * @return Returns 0 on success, else 1 on an unknown name.
+ */
+static int parseNames(
+		const char* text,
+		const char** names,
+		const int n_names,
+		int* use) {
+
+	char list[256];
+	strncpy(list, text, sizeof(list) - 1);
+	list[sizeof(list) - 1] = '\0';
+	unsigned int k;
+	for (k = 0; k < n_names; k++) {
+		use[k] = 0;
+	}
+	char* name;
+	for (name = strtok(list, ","); name; name = strtok(NULL, ",")) {
+		for (k = 0; k < n_names && strcmp(name, names[k]); k++);
+		if (k == n_names) {
+			printf("Input error: Unknown variant %s\n", name);
+			return 1;
+		}
+		use[k] = 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Walks the quadtree for every captured particle on threads threads, split
+ * as by the simulation's schedule, and returns the seconds taken. Sets the
+ * accelerations, the interactions of every particle and the slowest
+ * thread's busy time over the average.
+ */
+static double replayForce(
+		const capture_t* __restrict capture,
+		node_t* __restrict root,
+		const double theta_max,
+		const int threads,
+		const schedule_t schedule,
+		const int chunkSize,
+		const long* __restrict zoneStart,
+		double* __restrict a_x,
+		double* __restrict a_y,
+		unsigned int* __restrict interactions,
+		double* __restrict imbalance) {
+
+	const long N = capture->N;
+	const double* x = capture->particles.x;
+	const double* y = capture->particles.y;
+	const double G = capture->G;
+	const double eps0 = capture->eps0;
+	const double delta_t = capture->delta_t;
+	double busy[threads];
+	unsigned int t;
+	for (t = 0; t < threads; t++) {
+		busy[t] = 0.0;
+	}
+
+	const double start = wallTime();
+	#pragma omp parallel num_threads(threads)
+	{
+		const int thread = omp_get_thread_num();
+		const double threadStart = wallTime();
+		long i;
+		if (schedule == SCHEDULE_DYNAMIC) {
+			#pragma omp for schedule(dynamic, chunkSize) nowait
+			for (i = 0; i < N; i++) {
+				a_x[i] = 0.0;
+				a_y[i] = 0.0;
+				interactions[i] = 0;
+				calculateForces(x[i], y[i], root, G, eps0, delta_t, theta_max,
+						a_x + i, a_y + i, interactions + i);
+			}
+		} else if (schedule == SCHEDULE_STATIC) {
+			#pragma omp for schedule(static) nowait
+			for (i = 0; i < N; i++) {
+				a_x[i] = 0.0;
+				a_y[i] = 0.0;
+				interactions[i] = 0;
+				calculateForces(x[i], y[i], root, G, eps0, delta_t, theta_max,
+						a_x + i, a_y + i, interactions + i);
+			}
+		} else {
+			// Each thread takes its own zones of equal cost
+			const int threadCount = omp_get_num_threads();
+			unsigned int zone;
+			for (zone = thread; zone < threads; zone += threadCount) {
+				for (i = zoneStart[zone]; i < zoneStart[zone + 1]; i++) {
+					a_x[i] = 0.0;
+					a_y[i] = 0.0;
+					interactions[i] = 0;
+					calculateForces(x[i], y[i], root, G, eps0, delta_t,
+							theta_max, a_x + i, a_y + i, interactions + i);
+				}
+			}
+		}
+		busy[thread] = wallTime() - threadStart;
+	}
+	const double stop = wallTime();
+
+	double slowest = 0.0;
+	double mean = 0.0;
+	for (t = 0; t < threads; t++) {
+		slowest = busy[t] > slowest ? busy[t] : slowest;
+		mean += busy[t] / threads;
+	}
+	*imbalance = mean > 0.0 ? slowest / mean : 1.0;
+
+	return stop - start;
+}
+
+/**
+ * Writes the statistics of the seconds of every repetition as a CSV row,
+ * leaving out the columns that do not apply to the phase. Sorts seconds.
+ */
+static void writeRow(
+		FILE* fp,
+		const char* phase,
+		const capture_t* capture,
+		const char* nodes,
+		const char* schedule,
+		const double theta_max,
+		const int threads,
+		double* seconds,
+		const int reps,
+		const unsigned long interactions,
+		const double imbalance,
+		const double checksum) {
+
+	repetitionStats_t stats;
+	repetitionStats(seconds, reps, &stats);
+
+	fprintf(fp, "%s,%d,%ld,%s,%s,", phase, capture->step, capture->N,
+			nodes ? nodes : "", schedule ? schedule : "");
+	if (theta_max >= 0.0) {
+		fprintf(fp, "%g", theta_max);
+	}
+	fprintf(fp, ",%d,%d,%.9f,%.9f,%.9f,%.9f,", threads, reps,
+			stats.min, stats.median, stats.mean, stats.stddev);
+	if (interactions > 0) {
+		fprintf(fp, "%lu", interactions);
+	}
+	fprintf(fp, ",");
+	if (imbalance >= 0.0) {
+		fprintf(fp, "%.4f", imbalance);
+	}
+	fprintf(fp, ",");
+	if (checksum >= 0.0) {
+		fprintf(fp, "%.17g", checksum);
+	}
+	fprintf(fp, "\n");
+}
@@ -0,0 +1,129 @@
+#!/bin/bash
+# Strong and weak scaling studies of galsim.
+#
+# Strong scaling keeps N fixed and varies the threads, weak scaling grows N
+# in proportion to the threads. Every configuration runs REPS times, and the
+# median of the wall time and of every phase of the --timing report is kept.
+# Timestep phases are taken as the sum over steps of the slowest thread,
+# which is the time the phase held up the simulation.
+#
+# For every study, phase and thread count p the output has
+#   speedup      T(1) / T(p), times p for weak scaling
+#   efficiency   speedup / p
+#   karp_flatt   serial fraction (1/speedup - 1/p) / (1 - 1/p), empty at p = 1
+# A serial fraction that stays constant with p is a serial part of fixed
+# size, one that grows with p is parallel overhead.
+#
+# RUN BY (from this folder, after make):
+# ./scaling.sh
+# STUDY=strong N=1000000 THREADS="1 2 4 8" ./scaling.sh
+#
+# Settings, as environment variables:
+# STUDY         strong, weak or both (both)
+# N             Particles of strong scaling (100000)
+# N_PER_THREAD  Particles per thread of weak scaling (25000)
+# THREADS       Thread counts ("1 2 4 ..." up to the processors)
+# REPS          Runs of every configuration (3)
+# STEPS         Timesteps of every run (10)
+# THETA         theta_max (0.5)
+# DIST          Generated distribution, see --generate of galsim (plummer)
+# INPUT         .gal file with N particles for strong scaling, instead of DIST
+# FLAGS         More galsim flags, e.g. "--schedule dynamic"
+# OUTPUT        CSV file of the tables (scaling.csv)
+
+STUDY=${STUDY:-both}
+N=${N:-100000}
+N_PER_THREAD=${N_PER_THREAD:-25000}
+REPS=${REPS:-3}
+STEPS=${STEPS:-10}
+THETA=${THETA:-0.5}
+DIST=${DIST:-plummer}
+OUTPUT=${OUTPUT:-scaling.csv}
+if [ -z "$THREADS" ]; then
+	procs=$(nproc)
+	THREADS=1
+	for ((p = 2; p < procs; p *= 2)); do
+		THREADS="$THREADS $p"
+	done
+	[ "$procs" -gt 1 ] && THREADS="$THREADS $procs"
+fi
+
+PHASES="total read build force free write"
+WORK=$(mktemp -d) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+[ -x ./galsim ] || { echo "ERROR: Build galsim first (make)."; exit 1; }
+
+# Median of the numbers on stdin
+median() {
+	sort -g | awk '{ v[NR] = $1 } END {
+		if (NR == 0) exit
+		if (NR % 2) print v[(NR + 1) / 2]
+		else printf "%.9f\n", (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+# Runs galsim REPS times with n particles on p threads, and appends
+# "study,phase,p,n,median seconds" lines to $WORK/medians.csv
+measure() {
+	local study=$1 n=$2 p=$3 rep start stop
+	local input=- generate="--generate $DIST"
+	if [ "$study" = strong ] && [ -n "$INPUT" ]; then
+		input=$INPUT
+		generate=
+	fi
+	rm -f "$WORK"/phases.txt
+	for ((rep = 0; rep < REPS; rep++)); do
+		start=$(date +%s.%N)
+		./galsim "$n" "$input" "$STEPS" 1e-5 "$THETA" 0 "$p" $generate $FLAGS \
+				--output "$WORK/result.gal" --timing "$WORK/timing.csv" \
+				> /dev/null || { echo "ERROR: galsim failed ($n particles," \
+				"$p threads)."; exit 1; }
+		stop=$(date +%s.%N)
+		awk -v wall=$(awk -v a="$start" -v b="$stop" 'BEGIN { print b - a }') \
+				-F, 'BEGIN { print "total", wall }
+				$1 == "" && NR > 1 { print $2, $4 }
+				$1 == "total" { print $2, $5 }' \
+				"$WORK/timing.csv" >> "$WORK"/phases.txt
+	done
+	local phase
+	for phase in $PHASES; do
+		local value=$(awk -v phase=$phase '$1 == phase { print $2 }' \
+				"$WORK"/phases.txt | median)
+		[ -n "$value" ] && echo "$study,$phase,$p,$n,$value" \
+				>> "$WORK"/medians.csv
+	done
+	echo "$study scaling: $n particles, $p threads," \
+			"$(grep "^$study,total,$p,$n," "$WORK"/medians.csv | cut -d, -f5) s" >&2
+}
+
+: > "$WORK"/medians.csv
+for p in $THREADS; do
+	if [ "$STUDY" = strong ] || [ "$STUDY" = both ]; then
+		measure strong "$N" "$p"
+	fi
+	if [ "$STUDY" = weak ] || [ "$STUDY" = both ]; then
+		measure weak $((N_PER_THREAD * p)) "$p"
+	fi
+done
+
+# Speedup, efficiency and serial fraction against the smallest thread count
+awk -F, 'BEGIN { OFS = ","
+	print "study,phase,threads,N,median_s,speedup,efficiency,karp_flatt" }
+	{
+		key = $1 "," $2
+		if (!(key in base)) {
+			base[key] = $5
+			baseThreads[key] = $3
+		}
+		p = $3 / baseThreads[key]
+		speedup = $5 > 0 ? base[key] / $5 : 0
+		if ($1 == "weak") speedup *= p
+		serial = ""
+		if (p > 1 && speedup > 0)
+			serial = sprintf("%.4f", (1 / speedup - 1 / p) / (1 - 1 / p))
+		print $1, $2, $3, $4, $5, sprintf("%.4f", speedup),
+				sprintf("%.4f", speedup / p), serial
+	}' <(sort -s -t, -k1,1 "$WORK"/medians.csv) > "$OUTPUT"
+
+column -t -s, "$OUTPUT" 2> /dev/null || cat "$OUTPUT"
+echo "Wrote $OUTPUT"
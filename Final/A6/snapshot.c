@@ -0,0 +1,327 @@
+#include "snapshot.h"
+#include "numa.h"
+#include "io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static void* writeFrames(void* arg);
+
+static int resumeFrames(snapshotWriter_t* writer, const long end);
+
+static void addFrame(snapshotWriter_t* writer, const int step);
+
+static int writeFrame(
+		snapshotWriter_t* writer,
+		const double* frame,
+		const int step);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+snapshotWriter_t* snapshotOpen(
+		const char* filename,
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N,
+		const int interval,
+		const int firstStep,
+		const int encoding,
+		const double errorBound,
+		const int threads,
+		const long resume) {
+
+	// Create file to write, or open the trajectory to continue
+	int fd = resume ? open(filename, O_RDWR) :
+			open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		printf("%s\n", resume ? "ERROR: Failed to open trajectory file to continue"
+				: "ERROR: Failed to create trajectory file");
+		return NULL;
+	}
+
+	snapshotWriter_t* writer =
+			(snapshotWriter_t*) calloc(1, sizeof(snapshotWriter_t));
+	writer->fd = fd;
+	writer->N = N;
+	writer->interval = interval;
+	writer->encoding = encoding;
+	writer->threads = threads;
+	writer->buffers[0] = (double*) malloc(4 * N * sizeof(double));
+	writer->buffers[1] = (double*) malloc(4 * N * sizeof(double));
+	if (encoding != SNAPSHOT_RAW) {
+		writer->codec = codecCreate(N, encoding, errorBound);
+		writer->encoded = (unsigned char*) malloc(codecMaxBytes(N));
+	}
+	if (!(writer->buffers[0] && writer->buffers[1]) || (encoding != SNAPSHOT_RAW
+				&& !(writer->codec && writer->encoded))) {
+		printf("%s\n", "ERROR: Malloc failure");
+		close(fd);
+		free(writer->buffers[0]);
+		free(writer->buffers[1]);
+		codecFree(writer->codec);
+		free(writer->encoded);
+		free(writer);
+		return NULL;
+	}
+
+	int failed = 0;
+	if (resume) {
+		// The frame of the restart step, if any, is already in the file
+		failed = resumeFrames(writer, resume);
+	} else {
+		// Header, completed by snapshotClose()
+		long header[4] = { 0, N, 0, 0 };
+		memcpy(header, SNAPSHOT_MAGIC, 8);
+		failed = writeAll(fd, header, sizeof(header), 0);
+		writer->offset = sizeof(header);
+
+		// Constant columns
+		failed |= writeAll(fd, particles->mass, N * sizeof(double),
+				writer->offset);
+		writer->offset += N * sizeof(double);
+		failed |= writeAll(fd, brightness, N * sizeof(double), writer->offset);
+		writer->offset += N * sizeof(double);
+
+		// Initial state as first frame
+		double* frame = writer->buffers[0];
+		memcpy(frame, particles->x, N * sizeof(double));
+		memcpy(frame + N, particles->y, N * sizeof(double));
+		memcpy(frame + 2*N, particles->v_x, N * sizeof(double));
+		memcpy(frame + 3*N, particles->v_y, N * sizeof(double));
+		failed |= writeFrame(writer, frame, firstStep);
+	}
+
+	if (failed) {
+		printf("%s\n", "ERROR: Failed to write trajectory file");
+		close(fd);
+		free(writer->buffers[0]);
+		free(writer->buffers[1]);
+		codecFree(writer->codec);
+		free(writer->encoded);
+		free(writer->index);
+		free(writer);
+		return NULL;
+	}
+
+	// Start writer thread
+	pthread_mutex_init(&writer->lock, NULL);
+	pthread_cond_init(&writer->changed, NULL);
+	pthread_create(&writer->thread, NULL, writeFrames, (void*) writer);
+
+	return writer;
+}
+
+double* snapshotAcquire(snapshotWriter_t* writer) {
+
+	pthread_mutex_lock(&writer->lock);
+	while (writer->full[writer->next]) {
+		pthread_cond_wait(&writer->changed, &writer->lock);
+	}
+	double* buffer = writer->buffers[writer->next];
+	pthread_mutex_unlock(&writer->lock);
+
+	return buffer;
+}
+
+void snapshotSubmit(snapshotWriter_t* writer, const int step) {
+
+	pthread_mutex_lock(&writer->lock);
+	writer->steps[writer->next] = step;
+	writer->full[writer->next] = 1;
+	writer->next = !writer->next;
+	pthread_cond_broadcast(&writer->changed);
+	pthread_mutex_unlock(&writer->lock);
+}
+
+long snapshotSync(snapshotWriter_t* writer) {
+
+	pthread_mutex_lock(&writer->lock);
+	while (writer->full[0] || writer->full[1]) {
+		pthread_cond_wait(&writer->changed, &writer->lock);
+	}
+	writer->failed |= fsync(writer->fd) != 0;
+	const long end = writer->offset;
+	pthread_mutex_unlock(&writer->lock);
+
+	return end;
+}
+
+int snapshotClose(snapshotWriter_t* writer) {
+
+	// Let the writer finish the submitted frames
+	pthread_mutex_lock(&writer->lock);
+	writer->closing = 1;
+	pthread_cond_broadcast(&writer->changed);
+	pthread_mutex_unlock(&writer->lock);
+	pthread_join(writer->thread, NULL);
+
+	// Frame index at the end, then complete the header
+	int failed = writer->failed;
+	const long indexOffset = writer->offset;
+	failed |= writeAll(writer->fd, writer->index,
+			2 * writer->n_frames * sizeof(long), indexOffset);
+	const long counts[2] = { writer->n_frames, indexOffset };
+	failed |= writeAll(writer->fd, counts, sizeof(counts), 2 * sizeof(long));
+	failed |= close(writer->fd) != 0;
+	if (failed) {
+		printf("%s\n", "ERROR: Failed to write trajectory file");
+	}
+
+	pthread_mutex_destroy(&writer->lock);
+	pthread_cond_destroy(&writer->changed);
+	free(writer->buffers[0]);
+	free(writer->buffers[1]);
+	codecFree(writer->codec);
+	free(writer->encoded);
+	free(writer->index);
+	free(writer);
+
+	return failed;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+/**
+ * Writer thread. Writes full buffers in the order they were submitted until
+ * the writer is closed and no full buffer is left.
+ */
+static void* writeFrames(void* arg) {
+
+	snapshotWriter_t* writer = (snapshotWriter_t*) arg;
+	int current = 0; // Buffers are submitted alternately
+
+	// Compress on any CPU, not on the one the simulation pinned its master to
+	unpinThread();
+
+	pthread_mutex_lock(&writer->lock);
+	while (1) {
+		while (!writer->full[current] && !writer->closing) {
+			pthread_cond_wait(&writer->changed, &writer->lock);
+		}
+		if (!writer->full[current]) {
+			break;
+		}
+		const int step = writer->steps[current];
+		pthread_mutex_unlock(&writer->lock);
+
+		// Write without holding the lock
+		const int failed = writeFrame(writer, writer->buffers[current], step);
+
+		pthread_mutex_lock(&writer->lock);
+		writer->failed |= failed;
+		writer->full[current] = 0;
+		pthread_cond_broadcast(&writer->changed);
+		current = !current;
+	}
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+/**
+ * Appends a frame to the file, compressed unless raw, and adds it to the
+ * frame index. Every CODEC_KEYFRAME-th frame is a keyframe.
+ * Returns 0 on success, else 1.
+ */
+static int writeFrame(
+		snapshotWriter_t* writer,
+		const double* frame,
+		const int step) {
+
+	// Nothing to predict from in the first frame after a restart
+	const int keyframe = writer->n_frames % CODEC_KEYFRAME == 0
+			|| writer->n_frames == writer->firstNew;
+	addFrame(writer, step);
+
+	// Compress
+	const void* payload = frame;
+	long size = 4 * writer->N * sizeof(double);
+	if (writer->encoding != SNAPSHOT_RAW) {
+		size = encodeFrame(writer->codec, frame, keyframe, writer->encoded,
+				writer->threads);
+		if (!size) {
+			return 1;
+		}
+		payload = writer->encoded;
+	}
+
+	// Frame header and payload
+	const long frameHeader[3] = { step, writer->encoding, size };
+	int failed = writeAll(writer->fd, frameHeader, sizeof(frameHeader),
+			writer->offset);
+	writer->offset += sizeof(frameHeader);
+	failed |= writeAll(writer->fd, payload, size, writer->offset);
+	writer->offset += size;
+
+	return failed;
+}
+
+/**
+ * Indexes the frames of an existing trajectory up to end, and cuts off the
+ * rest. The header is reset until snapshotClose() completes it, so a stale
+ * frame index is never read.
+ * Returns 0 on success, else 1.
+ */
+static int resumeFrames(snapshotWriter_t* writer, const long end) {
+
+	// Header of a trajectory of the same N
+	long header[4];
+	if (pread(writer->fd, header, sizeof(header), 0) != sizeof(header)
+			|| memcmp(header, SNAPSHOT_MAGIC, 8) || header[1] != writer->N) {
+		printf("%s\n", "ERROR: Not a trajectory file with N particles");
+		return 1;
+	}
+
+	// Frames up to end, in the encoding of this run
+	writer->offset = sizeof(header) + 2 * writer->N * sizeof(double);
+	long frameHeader[3];
+	while (writer->offset < end) {
+		if (pread(writer->fd, frameHeader, sizeof(frameHeader), writer->offset)
+				!= sizeof(frameHeader) || frameHeader[2] < 0) {
+			printf("%s\n", "ERROR: Trajectory file is shorter than checkpointed");
+			return 1;
+		}
+		if (frameHeader[1] != writer->encoding) {
+			printf("%s\n", "ERROR: Trajectory file has another encoding");
+			return 1;
+		}
+		addFrame(writer, (int) frameHeader[0]);
+		writer->offset += sizeof(frameHeader) + frameHeader[2];
+	}
+	if (writer->offset != end) {
+		printf("%s\n", "ERROR: Trajectory file does not match the checkpoint");
+		return 1;
+	}
+	writer->firstNew = writer->n_frames;
+
+	const long counts[2] = { 0, 0 };
+	return ftruncate(writer->fd, end)
+			|| writeAll(writer->fd, counts, sizeof(counts), 2 * sizeof(long));
+}
+
+/**
+ * Adds a frame of timestep step at the end of the file to the frame index.
+ */
+static void addFrame(snapshotWriter_t* writer, const int step) {
+
+	// Grow index
+	if (writer->n_frames == writer->indexCapacity) {
+		writer->indexCapacity = writer->indexCapacity ?
+				2 * writer->indexCapacity : 64;
+		writer->index = (long*) realloc(writer->index,
+				2 * writer->indexCapacity * sizeof(long));
+	}
+	writer->index[2 * writer->n_frames] = step;
+	writer->index[2 * writer->n_frames + 1] = writer->offset;
+	writer->n_frames++;
+}
@@ -0,0 +1,118 @@
+/**
+ *	snapshot.h
+ *	Contains functions for writing trajectory snapshots in the background
+ *
+ *	Trajectory file layout, all fields 8 bytes:
+ *	- Header: magic "GALTRAJ1", N, number of frames, offset of frame index.
+ *	- mass and brightness of every particle, N doubles each.
+ *	- Frames: step, encoding, payload size in bytes, then the payload. A raw
+ *	  payload holds x, y, v_x and v_y of every particle, N doubles each, other
+ *	  encodings are described in codec.h.
+ *	- Frame index: step and file offset of every frame.
+ *
+ *	The frame count and index offset of the header are written by
+ *	snapshotClose(). A restarted run continues the trajectory from the end
+ *	recorded in its checkpoint, see snapshotSync().
+ */
+
+#pragma once
+#include "modules.h"
+#include "codec.h"
+#include <pthread.h>
+
+// Writes frames to a trajectory file from a background thread
+typedef struct snapshotWriter {
+	int fd;
+	long N;
+	int interval; // Timesteps between frames
+	int encoding; // Payload encoding of every frame
+	int threads; // Threads compressing a frame
+	codecState_t* codec; // Previous frame, unless raw
+	unsigned char* encoded; // Compressed frame
+
+	// Two frame buffers of 4*N doubles, filled by the simulation in turn
+	double* buffers[2];
+	int full[2]; // Buffer waits for the writer
+	int steps[2]; // Timestep of the frame in the buffer
+	int next; // Buffer the simulation fills next
+	int closing;
+	int failed;
+
+	// Frame index: step and file offset of every written frame
+	long* index;
+	int n_frames;
+	int firstNew; // First frame written by this writer, always a keyframe
+	int indexCapacity;
+	long offset; // End of file
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} snapshotWriter_t;
+
+/**
+ * Creates the trajectory file "filename", writes its header and the initial
+ * state as the first frame, and starts the writer thread. Frames are
+ * compressed by threads threads unless encoding is SNAPSHOT_RAW.
+ *
+ * If resume is nonzero the trajectory of a restarted run is continued
+ * instead: frames after resume are cut off, written after the checkpoint
+ * the run restarts from, and the next frame follows.
+ *
+ * @param filename   Trajectory filename.
+ * @param particles  Information about every particle.
+ * @param brightness Array with brightness information about every particle.
+ * @param N          The total number of particles.
+ * @param interval   Timesteps between frames.
+ * @param firstStep  Timestep of the initial state.
+ * @param encoding   SNAPSHOT_RAW, SNAPSHOT_DELTA or SNAPSHOT_QUANTIZED.
+ * @param errorBound Largest error of any value with SNAPSHOT_QUANTIZED.
+ * @param threads    Number of threads compressing a frame.
+ * @param resume     End of the trajectory to continue, from snapshotSync(),
+ *                   or 0 for a new trajectory.
+ * @return           The writer, or NULL on failure.
+ */
+snapshotWriter_t* snapshotOpen(
+		const char* filename,
+		particles_t* __restrict particles,
+		double* __restrict brightness,
+		const long N,
+		const int interval,
+		const int firstStep,
+		const int encoding,
+		const double errorBound,
+		const int threads,
+		const long resume);
+
+/**
+ * Returns a free frame buffer of 4*N doubles to copy x, y, v_x and v_y into.
+ * Only waits if the writer still holds both buffers.
+ *
+ * @param writer Snapshot writer.
+ */
+double* snapshotAcquire(snapshotWriter_t* writer);
+
+/**
+ * Hands the buffer from snapshotAcquire() to the writer thread.
+ *
+ * @param writer Snapshot writer.
+ * @param step   Timestep of the frame.
+ */
+void snapshotSubmit(snapshotWriter_t* writer, const int step);
+
+/**
+ * Waits until every submitted frame is written and flushes the file to disk,
+ * for a checkpoint.
+ *
+ * @param writer Snapshot writer.
+ * @return       End of the last frame, to continue the trajectory from.
+ */
+long snapshotSync(snapshotWriter_t* writer);
+
+/**
+ * Writes the remaining frames and the frame index, closes the file and frees
+ * the writer. Returns 0 if every frame was written, else 1.
+ *
+ * @param writer Snapshot writer.
+ */
+int snapshotClose(snapshotWriter_t* writer);
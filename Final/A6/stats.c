@@ -0,0 +1,133 @@
+#include "stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*******************************************************************************
+  STATIC VARIABLES
+ ******************************************************************************/
+
+__thread traversalStats_t threadTraversal;
+
+static treeStats_t tree;
+static traversalStats_t* traversal = NULL; // Collected counts per thread
+static int threads = 0;
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static void countNode(const node_t* node, const int depth);
+
+static void printTraversal(const char* name, const traversalStats_t* counts);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void statsBegin(const int n_threads) {
+
+	memset(&tree, 0, sizeof(tree));
+	free(traversal);
+	traversal = (traversalStats_t*) calloc(n_threads, sizeof(traversalStats_t));
+	threads = traversal ? n_threads : 0;
+}
+
+void countTree(const node_t* root) {
+
+	tree.builds++;
+	countNode(root, 0);
+}
+
+void countWalk(const unsigned int interactions) {
+
+	threadTraversal.particles++;
+	threadTraversal.interactions += interactions;
+	if (interactions > threadTraversal.maxInteractions) {
+		threadTraversal.maxInteractions = interactions;
+	}
+}
+
+void collectTraversal(const int thread) {
+
+	if (thread < threads) {
+		traversalStats_t* counts = traversal + thread;
+		counts->particles += threadTraversal.particles;
+		counts->visited += threadTraversal.visited;
+		counts->opened += threadTraversal.opened;
+		counts->interactions += threadTraversal.interactions;
+		if (threadTraversal.maxInteractions > counts->maxInteractions) {
+			counts->maxInteractions = threadTraversal.maxInteractions;
+		}
+	}
+	memset(&threadTraversal, 0, sizeof(threadTraversal));
+}
+
+void statsReport(void) {
+
+	// Quadtree shape, per build
+	const unsigned long builds = tree.builds ? tree.builds : 1;
+	printf("Tree: %lu builds, %.1f nodes and %.1f leaves per build, "
+			"max depth %d\n", tree.builds, (double) tree.nodes / builds,
+			(double) tree.leaves / builds, tree.maxDepth);
+	printf("Tree: nodes per depth per build");
+	unsigned int depth;
+	for (depth = 0; depth <= tree.maxDepth && depth < STATS_MAX_DEPTH;
+			depth++) {
+		printf(" %u:%.1f", depth, (double) tree.depthHistogram[depth] / builds);
+	}
+	printf("\n");
+
+	// Traversal, per thread and in total
+	traversalStats_t total;
+	memset(&total, 0, sizeof(total));
+	unsigned int i;
+	for (i = 0; i < threads; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "thread %u", i);
+		printTraversal(name, traversal + i);
+		total.particles += traversal[i].particles;
+		total.visited += traversal[i].visited;
+		total.opened += traversal[i].opened;
+		total.interactions += traversal[i].interactions;
+		if (traversal[i].maxInteractions > total.maxInteractions) {
+			total.maxInteractions = traversal[i].maxInteractions;
+		}
+	}
+	printTraversal("total", &total);
+
+	free(traversal);
+	traversal = NULL;
+	threads = 0;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static void countNode(const node_t* node, const int depth) {
+
+	tree.nodes++;
+	tree.depthHistogram[depth < STATS_MAX_DEPTH ? depth : STATS_MAX_DEPTH - 1]++;
+	if (depth > tree.maxDepth) {
+		tree.maxDepth = depth;
+	}
+	if (node->children) {
+		unsigned int i;
+		for (i = 0; i < 4; i++) {
+			countNode(node->children + i, depth + 1);
+		}
+	} else if (node->mass) {
+		tree.leaves++;
+	}
+}
+
+static void printTraversal(const char* name, const traversalStats_t* counts) {
+
+	const double particles = counts->particles ? counts->particles : 1;
+	printf("Traversal %s: %lu walks, %.1f visited, %.1f opened and "
+			"%.1f interactions per particle, max %lu interactions\n",
+			name, counts->particles, counts->visited / particles,
+			counts->opened / particles, counts->interactions / particles,
+			counts->maxInteractions);
+}
@@ -0,0 +1,60 @@
+/**
+ *	stats.h
+ *	Contains counters of quadtree shape and traversal cost
+ *
+ *	Only compiled in with -DTREE_STATS (see the Makefile), otherwise no
+ *	counter is touched. Quadtree shape is counted after every build, by the
+ *	building thread. Traversal counts are kept per thread and collected at the
+ *	end of every parallel region, then printed when the simulation ends.
+ */
+
+#pragma once
+#include "modules.h"
+
+#define STATS_MAX_DEPTH 64 // Deeper nodes are counted at the last depth
+
+// Quadtree shape, summed over all builds
+typedef struct treeStats {
+	unsigned long builds;
+	unsigned long nodes; // Nodes created, including roots
+	unsigned long leaves; // Nodes holding a particle
+	int maxDepth;
+	unsigned long depthHistogram[STATS_MAX_DEPTH]; // Nodes per depth
+} treeStats_t;
+
+// Cost of calculateForces() walks
+typedef struct traversalStats {
+	unsigned long particles; // Particle walks
+	unsigned long visited; // Nodes visited
+	unsigned long opened; // Nodes opened, their children are visited
+	unsigned long interactions; // Particle-node interactions
+	unsigned long maxInteractions; // Most interactions of one particle walk
+} traversalStats_t;
+
+// Traversal counts of the calling thread, not yet collected
+extern __thread traversalStats_t threadTraversal;
+
+/**
+ * Starts counting, for n_threads threads.
+ */
+void statsBegin(const int n_threads);
+
+/**
+ * Adds the shape of the quadtree below root.
+ */
+void countTree(const node_t* root);
+
+/**
+ * Counts a particle walk of interactions interactions on the calling thread.
+ */
+void countWalk(const unsigned int interactions);
+
+/**
+ * Adds the counts of the calling thread to those of thread, and clears them.
+ */
+void collectTraversal(const int thread);
+
+/**
+ * Prints the counts, per thread and in total, and stops counting.
+ */
+void statsReport(void);
@@ -0,0 +1,687 @@
+#define _GNU_SOURCE
+#include "timing.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <omp.h>
+
+static const char* phaseNames[N_PHASES] =
+		{ "read", "build", "force", "free", "write" };
+
+static const char* counterNames[N_COUNTERS] = { "cycles", "instructions",
+		"l1d_misses", "llc_misses", "dtlb_misses", "branch_misses" };
+
+// perf_event_open type and config of every counter
+#define CACHE_READ_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+		| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+static const unsigned int counterTypes[N_COUNTERS] = { PERF_TYPE_HARDWARE,
+		PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+		PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE };
+static const unsigned long counterConfigs[N_COUNTERS] = {
+		PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+		CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D), PERF_COUNT_HW_CACHE_MISSES,
+		CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB), PERF_COUNT_HW_BRANCH_MISSES };
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static int isStepPhase(const phase_t phase);
+
+static int statistics(
+		const double* values,
+		const int n,
+		double* min,
+		double* max,
+		double* mean);
+
+static void stepValues(
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		double* values);
+
+static int summarize(
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		double* values,
+		double* stats);
+
+static int openCounter(const counter_t counter);
+
+static int counterOpened(const timing_t* timing, const counter_t counter);
+
+static void counterValues(
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		const counter_t counter,
+		long long* values);
+
+static void writeCsvLine(
+		FILE* fp,
+		const char* step,
+		const char* phase,
+		const double* values,
+		const int n_threads,
+		const int count,
+		const double* stats);
+
+static void writeCsvCounters(
+		FILE* fp,
+		const timing_t* timing,
+		const int step,
+		const phase_t phase);
+
+static void writeJsonPhase(
+		FILE* fp,
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		const double* values,
+		const int count,
+		const double* stats);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+double wallTime(void) {
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+timing_t* timingCreate(const int firstStep, const int nsteps,
+		const int n_threads) {
+
+	timing_t* timing = (timing_t*) malloc(sizeof(timing_t));
+	if (!timing) {
+		return NULL;
+	}
+	timing->firstStep = firstStep;
+	timing->nsteps = nsteps;
+	timing->n_threads = n_threads;
+	const size_t n = (size_t) (nsteps > firstStep ? nsteps - firstStep : 0)
+			* n_threads * N_PHASES;
+	timing->seconds = (double*) malloc((n ? n : 1) * sizeof(double));
+	if (!timing->seconds) {
+		free(timing);
+		return NULL;
+	}
+	size_t i;
+	for (i = 0; i < n; i++) {
+		timing->seconds[i] = -1.0;
+	}
+	for (i = 0; i < N_PHASES; i++) {
+		timing->once[i] = -1.0;
+	}
+	timing->counters = NULL;
+	timing->counts = NULL;
+
+	return timing;
+}
+
+void timingFree(timing_t* timing) {
+
+	if (timing) {
+		if (timing->counters) {
+			unsigned int i;
+			for (i = 0; i < timing->n_threads * N_COUNTERS; i++) {
+				if (timing->counters[i] >= 0) {
+					close(timing->counters[i]);
+				}
+			}
+		}
+		free(timing->counters);
+		free(timing->counts);
+		free(timing->seconds);
+		free(timing);
+	}
+}
+
+int timingCountersStart(timing_t* timing) {
+
+	const size_t n = (size_t) (timing->nsteps > timing->firstStep ?
+			timing->nsteps - timing->firstStep : 0)
+			* timing->n_threads * N_PHASES * N_COUNTERS;
+	timing->counters = (int*) malloc(timing->n_threads * N_COUNTERS
+			* sizeof(int));
+	timing->counts = (long long*) malloc((n ? n : 1) * sizeof(long long));
+	if (!timing->counters || !timing->counts) {
+		free(timing->counters);
+		free(timing->counts);
+		timing->counters = NULL;
+		timing->counts = NULL;
+		return 0;
+	}
+	size_t i;
+	for (i = 0; i < n; i++) {
+		timing->counts[i] = -1;
+	}
+
+	// Each thread counts itself, from user space only
+	int opened = 0;
+	#pragma omp parallel num_threads(timing->n_threads) reduction(+:opened)
+	{
+		int* fds = timing->counters + omp_get_thread_num() * N_COUNTERS;
+		unsigned int counter;
+		for (counter = 0; counter < N_COUNTERS; counter++) {
+			fds[counter] = openCounter(counter);
+			opened += fds[counter] >= 0;
+		}
+	}
+
+	// Nothing to report without counters
+	if (!opened) {
+		free(timing->counters);
+		free(timing->counts);
+		timing->counters = NULL;
+		timing->counts = NULL;
+	}
+
+	return opened;
+}
+
+int countersOpen(const counter_t counter, const int n_threads, int* fds) {
+
+	int opened = 0;
+	#pragma omp parallel num_threads(n_threads) reduction(+:opened)
+	{
+		const int fd = openCounter(counter);
+		fds[omp_get_thread_num()] = fd;
+		opened += fd >= 0;
+	}
+
+	return opened;
+}
+
+long long countersClose(const int* fds, const int n_threads) {
+
+	long long events = 0;
+	unsigned int i;
+	for (i = 0; i < n_threads; i++) {
+		long long count;
+		if (fds[i] < 0
+				|| read(fds[i], &count, sizeof(long long)) != sizeof(long long)) {
+			events = -1;
+		} else if (events >= 0) {
+			events += count;
+		}
+		if (fds[i] >= 0) {
+			close(fds[i]);
+		}
+	}
+
+	return events;
+}
+
+void timingStart(const timing_t* timing, const int thread, timingMark_t* mark) {
+
+	if (timing && timing->counters && thread < timing->n_threads) {
+		const int* fds = timing->counters + thread * N_COUNTERS;
+		unsigned int counter;
+		for (counter = 0; counter < N_COUNTERS; counter++) {
+			if (fds[counter] < 0 || read(fds[counter], mark->counts + counter,
+					sizeof(long long)) != sizeof(long long)) {
+				mark->counts[counter] = -1;
+			}
+		}
+	}
+	mark->seconds = wallTime();
+}
+
+void timingStop(
+		timing_t* timing,
+		const int step,
+		const int thread,
+		const phase_t phase,
+		const timingMark_t* mark) {
+
+	if (!timing) {
+		return;
+	}
+	timingAdd(timing, step, thread, phase, wallTime() - mark->seconds);
+	if (!timing->counters || step < timing->firstStep
+			|| step >= timing->nsteps || thread >= timing->n_threads) {
+		return;
+	}
+
+	const int* fds = timing->counters + thread * N_COUNTERS;
+	long long* counts = timing->counts + (((size_t) (step - timing->firstStep)
+			* timing->n_threads + thread) * N_PHASES + phase) * N_COUNTERS;
+	unsigned int counter;
+	for (counter = 0; counter < N_COUNTERS; counter++) {
+		long long now;
+		if (mark->counts[counter] >= 0 && read(fds[counter], &now,
+				sizeof(long long)) == sizeof(long long)) {
+			const long long events = now - mark->counts[counter];
+			counts[counter] = counts[counter] < 0 ?
+					events : counts[counter] + events;
+		}
+	}
+}
+
+void timingAdd(
+		timing_t* timing,
+		const int step,
+		const int thread,
+		const phase_t phase,
+		const double seconds) {
+
+	if (!timing || step < timing->firstStep || step >= timing->nsteps
+			|| thread >= timing->n_threads) {
+		return;
+	}
+
+	double* value = timing->seconds + ((size_t) (step - timing->firstStep)
+			* timing->n_threads + thread) * N_PHASES + phase;
+	*value = *value < 0.0 ? seconds : *value + seconds;
+}
+
+void timingAddOnce(timing_t* timing, const phase_t phase,
+		const double seconds) {
+
+	if (timing) {
+		timing->once[phase] = timing->once[phase] < 0.0 ?
+				seconds : timing->once[phase] + seconds;
+	}
+}
+
+int writeTiming(const timing_t* timing, const char* filename) {
+
+	FILE* fp = fopen(filename, "w");
+	if (!fp) {
+		printf("%s\n", "ERROR: Failed to open timing report file.");
+		return 1;
+	}
+
+	const int n_threads = timing->n_threads;
+	double values[n_threads];
+	double stats[3];
+	int count;
+	const size_t length = strlen(filename);
+	const int json = length >= 5 && !strcmp(filename + length - 5, ".json");
+	int step;
+	unsigned int phase;
+	if (json) {
+		fprintf(fp, "{\n\"threads\": %d,\n\"first_step\": %d,\n\"steps\": %d,\n",
+				n_threads, timing->firstStep, timing->nsteps);
+		for (phase = 0; phase < N_PHASES; phase++) {
+			if (!isStepPhase(phase)) {
+				fprintf(fp, "\"%s\": ", phaseNames[phase]);
+				if (timing->once[phase] < 0.0) {
+					fprintf(fp, "null,\n");
+				} else {
+					fprintf(fp, "%.9f,\n", timing->once[phase]);
+				}
+			}
+		}
+
+		// Sum over timesteps
+		fprintf(fp, "\"total\": {");
+		const char* separator = "";
+		for (phase = 0; phase < N_PHASES; phase++) {
+			if (isStepPhase(phase)) {
+				count = summarize(timing, -1, phase, values, stats);
+				fprintf(fp, "%s\n  ", separator);
+				writeJsonPhase(fp, timing, -1, phase, values, count, stats);
+				separator = ",";
+			}
+		}
+
+		// Every timestep
+		fprintf(fp, "\n},\n\"timesteps\": [");
+		for (step = timing->firstStep; step < timing->nsteps; step++) {
+			fprintf(fp, "%s\n{\"step\": %d", step > timing->firstStep ? "," : "",
+					step);
+			for (phase = 0; phase < N_PHASES; phase++) {
+				if (isStepPhase(phase)) {
+					count = summarize(timing, step, phase, values, stats);
+					fprintf(fp, ",\n  ");
+					writeJsonPhase(fp, timing, step, phase, values, count,
+							stats);
+				}
+			}
+			fprintf(fp, "}");
+		}
+		fprintf(fp, "\n]\n}\n");
+	} else {
+		fprintf(fp, "step,phase,threads,min,max,mean");
+		unsigned int thread;
+		for (thread = 0; thread < n_threads; thread++) {
+			fprintf(fp, ",thread_%u", thread);
+		}
+		unsigned int counter;
+		for (counter = 0; counter < N_COUNTERS && timing->counts; counter++) {
+			if (!counterOpened(timing, counter)) {
+				continue;
+			}
+			fprintf(fp, ",%s", counterNames[counter]);
+			for (thread = 0; thread < n_threads; thread++) {
+				fprintf(fp, ",%s_thread_%u", counterNames[counter], thread);
+			}
+		}
+		fprintf(fp, "\n");
+
+		// Phases outside the loop, with an empty step
+		for (phase = 0; phase < N_PHASES; phase++) {
+			if (!isStepPhase(phase) && timing->once[phase] >= 0.0) {
+				fprintf(fp, ",%s,1,%.9f,%.9f,%.9f", phaseNames[phase],
+						timing->once[phase], timing->once[phase],
+						timing->once[phase]);
+				for (thread = 0; thread < n_threads; thread++) {
+					fprintf(fp, ",");
+				}
+				writeCsvCounters(fp, timing, -1, phase);
+				fprintf(fp, "\n");
+			}
+		}
+
+		// Sum over timesteps, then every timestep
+		for (phase = 0; phase < N_PHASES; phase++) {
+			if (isStepPhase(phase)) {
+				count = summarize(timing, -1, phase, values, stats);
+				writeCsvLine(fp, "total", phaseNames[phase], values, n_threads,
+						count, stats);
+				writeCsvCounters(fp, timing, -1, phase);
+				fprintf(fp, "\n");
+			}
+		}
+		for (step = timing->firstStep; step < timing->nsteps; step++) {
+			char stepName[16];
+			snprintf(stepName, sizeof(stepName), "%d", step);
+			for (phase = 0; phase < N_PHASES; phase++) {
+				if (isStepPhase(phase)) {
+					count = summarize(timing, step, phase, values, stats);
+					writeCsvLine(fp, stepName, phaseNames[phase], values,
+							n_threads, count, stats);
+					writeCsvCounters(fp, timing, step, phase);
+					fprintf(fp, "\n");
+				}
+			}
+		}
+	}
+
+	if (fclose(fp)) {
+		printf("%s\n", "ERROR: Failed to write timing report file.");
+		return 1;
+	}
+
+	return 0;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static int isStepPhase(const phase_t phase) {
+
+	return phase != PHASE_READ && phase != PHASE_WRITE;
+}
+
+/**
+ * Sets min, max and mean of the values that are not negative, and returns
+ * their number. All are 0 if there are none.
+ */
+static int statistics(
+		const double* values,
+		const int n,
+		double* min,
+		double* max,
+		double* mean) {
+
+	int count = 0;
+	double sum = 0.0;
+	*min = 0.0;
+	*max = 0.0;
+	unsigned int i;
+	for (i = 0; i < n; i++) {
+		if (values[i] >= 0.0) {
+			if (!count || values[i] < *min) *min = values[i];
+			if (!count || values[i] > *max) *max = values[i];
+			sum += values[i];
+			count++;
+		}
+	}
+	*mean = count ? sum / count : 0.0;
+
+	return count;
+}
+
+// Seconds of every thread in phase during timestep step
+static void stepValues(
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		double* values) {
+
+	unsigned int thread;
+	for (thread = 0; thread < timing->n_threads; thread++) {
+		values[thread] = timing->seconds[((size_t) (step - timing->firstStep)
+				* timing->n_threads + thread) * N_PHASES + phase];
+	}
+}
+
+/**
+ * Sets the seconds of every thread in phase during timestep step, and min,
+ * max and mean over the threads that ran it in stats. Returns the number of
+ * such threads. With step -1, all are summed over the timesteps: the sum of
+ * the max is the time the phase held up the simulation.
+ */
+static int summarize(
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		double* values,
+		double* stats) {
+
+	if (step >= 0) {
+		stepValues(timing, step, phase, values);
+		return statistics(values, timing->n_threads,
+				stats, stats + 1, stats + 2);
+	}
+
+	double stepTotals[timing->n_threads];
+	double stepStats[3];
+	int count = 0;
+	unsigned int thread;
+	for (thread = 0; thread < timing->n_threads; thread++) {
+		values[thread] = -1.0;
+	}
+	stats[0] = stats[1] = stats[2] = 0.0;
+	int s;
+	for (s = timing->firstStep; s < timing->nsteps; s++) {
+		const int stepCount = summarize(timing, s, phase, stepTotals, stepStats);
+		count = stepCount > count ? stepCount : count;
+		stats[0] += stepStats[0];
+		stats[1] += stepStats[1];
+		stats[2] += stepStats[2];
+		for (thread = 0; thread < timing->n_threads; thread++) {
+			if (stepTotals[thread] >= 0.0) {
+				values[thread] = values[thread] < 0.0 ?
+						stepTotals[thread] : values[thread] + stepTotals[thread];
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * Sets the events of counter of every thread in phase during timestep step,
+ * -1 if not counted. With step -1, events are summed over the timesteps.
+ */
+static void counterValues(
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		const counter_t counter,
+		long long* values) {
+
+	unsigned int thread;
+	for (thread = 0; thread < timing->n_threads; thread++) {
+		values[thread] = -1;
+		if (!isStepPhase(phase)) {
+			continue;
+		}
+		int s;
+		for (s = step < 0 ? timing->firstStep : step;
+				s < (step < 0 ? timing->nsteps : step + 1); s++) {
+			const long long events = timing->counts[(((size_t) (s
+					- timing->firstStep) * timing->n_threads + thread)
+					* N_PHASES + phase) * N_COUNTERS + counter];
+			if (events >= 0) {
+				values[thread] = values[thread] < 0 ?
+						events : values[thread] + events;
+			}
+		}
+	}
+}
+
+static void writeCsvLine(
+		FILE* fp,
+		const char* step,
+		const char* phase,
+		const double* values,
+		const int n_threads,
+		const int count,
+		const double* stats) {
+
+	fprintf(fp, "%s,%s,%d,%.9f,%.9f,%.9f", step, phase, count,
+			stats[0], stats[1], stats[2]);
+	unsigned int thread;
+	for (thread = 0; thread < n_threads; thread++) {
+		if (values[thread] >= 0.0) {
+			fprintf(fp, ",%.9f", values[thread]);
+		} else {
+			fprintf(fp, ",");
+		}
+	}
+}
+
+/**
+ * Returns 1 if any thread opened counter, else 0.
+ */
+/**
+ * Opens counter for the calling thread, counting its events in user space
+ * only. Returns the file descriptor, or -1 if unavailable.
+ */
+static int openCounter(const counter_t counter) {
+
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = counterTypes[counter];
+	attr.config = counterConfigs[counter];
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static int counterOpened(const timing_t* timing, const counter_t counter) {
+
+	unsigned int thread;
+	for (thread = 0; thread < timing->n_threads; thread++) {
+		if (timing->counters[thread * N_COUNTERS + counter] >= 0) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * Writes the events of every counter, summed over threads and then per
+ * thread, if counters were started.
+ */
+static void writeCsvCounters(
+		FILE* fp,
+		const timing_t* timing,
+		const int step,
+		const phase_t phase) {
+
+	if (!timing->counts) {
+		return;
+	}
+	long long values[timing->n_threads];
+	unsigned int counter;
+	for (counter = 0; counter < N_COUNTERS; counter++) {
+		if (!counterOpened(timing, counter)) {
+			continue;
+		}
+		counterValues(timing, step, phase, counter, values);
+		long long sum = -1;
+		unsigned int thread;
+		for (thread = 0; thread < timing->n_threads; thread++) {
+			if (values[thread] >= 0) {
+				sum = sum < 0 ? values[thread] : sum + values[thread];
+			}
+		}
+		if (sum >= 0) {
+			fprintf(fp, ",%lld", sum);
+		} else {
+			fprintf(fp, ",");
+		}
+		for (thread = 0; thread < timing->n_threads; thread++) {
+			if (values[thread] >= 0) {
+				fprintf(fp, ",%lld", values[thread]);
+			} else {
+				fprintf(fp, ",");
+			}
+		}
+	}
+}
+
+static void writeJsonPhase(
+		FILE* fp,
+		const timing_t* timing,
+		const int step,
+		const phase_t phase,
+		const double* values,
+		const int count,
+		const double* stats) {
+
+	fprintf(fp, "\"%s\": {\"count\": %d, \"min\": %.9f, \"max\": %.9f, "
+			"\"mean\": %.9f, \"threads\": [", phaseNames[phase], count,
+			stats[0], stats[1], stats[2]);
+	unsigned int thread;
+	for (thread = 0; thread < timing->n_threads; thread++) {
+		if (values[thread] >= 0.0) {
+			fprintf(fp, "%s%.9f", thread ? ", " : "", values[thread]);
+		} else {
+			fprintf(fp, "%snull", thread ? ", " : "");
+		}
+	}
+	fprintf(fp, "]");
+
+	// Events per thread of every counter
+	if (timing->counts) {
+		long long events[timing->n_threads];
+		unsigned int counter;
+		for (counter = 0; counter < N_COUNTERS; counter++) {
+			if (!counterOpened(timing, counter)) {
+				continue;
+			}
+			counterValues(timing, step, phase, counter, events);
+			fprintf(fp, ", \"%s\": [", counterNames[counter]);
+			for (thread = 0; thread < timing->n_threads; thread++) {
+				if (events[thread] >= 0) {
+					fprintf(fp, "%s%lld", thread ? ", " : "", events[thread]);
+				} else {
+					fprintf(fp, "%snull", thread ? ", " : "");
+				}
+			}
+			fprintf(fp, "]");
+		}
+	}
+	fprintf(fp, "}");
+}
@@ -0,0 +1,141 @@
+/**
+ *	timing.h
+ *	Contains functions for timing the phases of a simulation
+ *
+ *	Every timestep phase is timed per thread, phases outside the timestep
+ *	loop once. The report has, for every timestep and phase, the seconds of
+ *	every thread that ran the phase and their min, max and mean, so load
+ *	imbalance between threads shows as a max well above the mean.
+ *
+ *	Optionally, timestep phases also count hardware events per thread with
+ *	perf_event_open: cycles, instructions, L1 data and last level cache
+ *	misses, data TLB misses and branch misses. Counters the kernel or CPU
+ *	does not offer on any thread are left out of the report, so without
+ *	perf_event_open there are no counter columns at all. A counter a thread
+ *	could not open is empty in CSV and null in JSON for that thread.
+ */
+
+#pragma once
+
+// Timed phases
+typedef enum phase {
+	PHASE_READ, // Reading, generating or restoring the particles
+	PHASE_BUILD, // Building the quadtree
+	PHASE_FORCE, // Walking the quadtree and updating the particles
+	PHASE_FREE, // Freeing the quadtree
+	PHASE_WRITE, // Writing the output file
+	N_PHASES
+} phase_t;
+
+// Counted hardware events
+typedef enum counter {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_L1D_MISSES, // L1 data cache read misses
+	COUNTER_LLC_MISSES, // Last level cache misses
+	COUNTER_DTLB_MISSES, // Data TLB read misses
+	COUNTER_BRANCH_MISSES,
+	N_COUNTERS
+} counter_t;
+
+// Seconds spent in every phase
+typedef struct timing {
+	int firstStep;
+	int nsteps;
+	int n_threads;
+	double* seconds; // Per timestep, thread and phase, -1 if not run
+	double once[N_PHASES]; // Phases outside the timestep loop, -1 if not run
+	int* counters; // Per thread and counter, file descriptor or -1, or NULL
+	long long* counts; // Per timestep, thread, phase and counter, -1 if none
+} timing_t;
+
+// Start of a timed phase
+typedef struct timingMark {
+	double seconds;
+	long long counts[N_COUNTERS]; // -1 if not counted
+} timingMark_t;
+
+/**
+ * Returns the wall-clock time in seconds from an arbitrary start.
+ */
+double wallTime(void);
+
+/**
+ * Creates the timing of timesteps firstStep to nsteps - 1 on n_threads
+ * threads, with no phase run yet.
+ *
+ * @return The timing, or NULL on failure.
+ */
+timing_t* timingCreate(const int firstStep, const int nsteps,
+		const int n_threads);
+
+void timingFree(timing_t* timing);
+
+/**
+ * Adds seconds to phase of thread during timestep step. Does nothing if
+ * timing is NULL.
+ */
+void timingAdd(
+		timing_t* timing,
+		const int step,
+		const int thread,
+		const phase_t phase,
+		const double seconds);
+
+/**
+ * Opens the hardware counters of every thread, from a parallel region of
+ * n_threads threads. Each thread counts its own events in user space, so
+ * phases must be started and stopped by the thread they are added to.
+ *
+ * @return The number of counters opened.
+ */
+int timingCountersStart(timing_t* timing);
+
+/**
+ * Opens counter on every thread of a parallel region of n_threads threads,
+ * to count a whole run rather than phases. Each thread counts its own events
+ * in user space.
+ *
+ * @param fds Set to the file descriptor of every thread, -1 if unavailable.
+ * @return    The number of threads counting.
+ */
+int countersOpen(const counter_t counter, const int n_threads, int* fds);
+
+/**
+ * Closes the counters of countersOpen().
+ *
+ * @return The events of all threads, or -1 if a thread was not counting.
+ */
+long long countersClose(const int* fds, const int n_threads);
+
+/**
+ * Marks the start of a phase on thread, the calling thread.
+ */
+void timingStart(const timing_t* timing, const int thread, timingMark_t* mark);
+
+/**
+ * Adds the seconds and counted events since mark to phase of thread, the
+ * calling thread, during timestep step. Does nothing if timing is NULL.
+ */
+void timingStop(
+		timing_t* timing,
+		const int step,
+		const int thread,
+		const phase_t phase,
+		const timingMark_t* mark);
+
+/**
+ * Adds seconds to a phase outside the timestep loop. Does nothing if
+ * timing is NULL.
+ */
+void timingAddOnce(timing_t* timing, const phase_t phase,
+		const double seconds);
+
+/**
+ * Writes the timing report to filename, as JSON if the name ends in .json,
+ * else as CSV with one line per timestep and phase. Counted events follow the
+ * seconds, summed over threads and then per thread.
+ *
+ * @return Returns 0 on success, else 1.
+ */
+int writeTiming(const timing_t* timing, const char* filename);
@@ -0,0 +1,63 @@
+#include "tools.h"
+#include <stdlib.h>
+#include <math.h>
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+int parseCheckedList(
+		const char* text,
+		double* values,
+		const int max_values,
+		const double minimum,
+		const int integral) {
+
+	int n = 0;
+	char* end;
+	while (n < max_values) {
+		values[n] = strtod(text, &end);
+		if (end == text || (*end != ',' && *end != '\0')
+				|| !(values[n] >= minimum)
+				|| (integral && values[n] != floor(values[n]))) {
+			return 0;
+		}
+		n++;
+		if (*end != ',') {
+			break;
+		}
+		text = end + 1;
+	}
+
+	return n;
+}
+
+int compareDoubles(const void* a, const void* b) {
+
+	const double x = *(const double*) a;
+	const double y = *(const double*) b;
+
+	return (x > y) - (x < y);
+}
+
+void repetitionStats(
+		double* __restrict seconds,
+		const int reps,
+		repetitionStats_t* __restrict stats) {
+
+	qsort(seconds, reps, sizeof(double), compareDoubles);
+	stats->min = seconds[0];
+	stats->median = reps % 2 ? seconds[reps / 2] :
+			0.5 * (seconds[reps / 2 - 1] + seconds[reps / 2]);
+	double mean = 0.0;
+	unsigned int i;
+	for (i = 0; i < reps; i++) {
+		mean += seconds[i] / reps;
+	}
+	double variance = 0.0;
+	for (i = 0; i < reps; i++) {
+		variance += (seconds[i] - mean) * (seconds[i] - mean);
+	}
+	stats->mean = mean;
+	stats->stddev = reps > 1 ? sqrt(variance / (reps - 1)) : 0.0;
+}
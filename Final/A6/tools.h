@@ -0,0 +1,45 @@
+/**
+ *	tools.h
+ *	Contains helpers shared by the benchmark tools
+ *
+ *	galbench, galaccuracy and galreplay take comma separated lists of values
+ *	as flags, and repeat every measurement to report the spread of its
+ *	seconds.
+ */
+
+#pragma once
+
+// Statistics of the seconds of repeated runs
+typedef struct repetitionStats {
+	double min;
+	double median;
+	double mean;
+	double stddev; // Sample standard deviation, 0 for a single run
+} repetitionStats_t;
+
+/**
+ * Reads a comma separated list of at most max_values numbers into values.
+ * Rejects the whole list if an entry is not a number of at least minimum, or
+ * not a whole number if integral is nonzero.
+ *
+ * @return The number of values read, or 0 on an invalid entry.
+ */
+int parseCheckedList(
+		const char* text,
+		double* values,
+		const int max_values,
+		const double minimum,
+		const int integral);
+
+/**
+ * Orders doubles ascending, for qsort().
+ */
+int compareDoubles(const void* a, const void* b);
+
+/**
+ * Sets stats from the seconds of reps repeated runs. Sorts seconds.
+ */
+void repetitionStats(
+		double* __restrict seconds,
+		const int reps,
+		repetitionStats_t* __restrict stats);
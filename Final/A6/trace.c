@@ -0,0 +1,174 @@
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TRACE_NAME 32 // Longest thread name
+
+// Begin or end of a phase
+typedef struct traceEvent {
+	const char* name;
+	double time; // Microseconds since traceOpen()
+	char begin;
+} traceEvent_t;
+
+// Events of one thread, written by that thread only. Aligned to keep the
+// counters of different threads off the same cache line.
+typedef struct traceBuffer {
+	traceEvent_t* events;
+	long count;
+	long dropped;
+	char name[TRACE_NAME];
+} __attribute__((aligned(64))) traceBuffer_t;
+
+/*******************************************************************************
+  STATIC VARIABLES
+ ******************************************************************************/
+
+static traceBuffer_t* buffers = NULL;
+static int threads = 0;
+static long capacity = 0;
+static double start = 0.0;
+static const char* traceFilename = NULL;
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ ******************************************************************************/
+
+static double now(void);
+
+static inline void record(const int thread, const char* name, const char begin);
+
+/*******************************************************************************
+  PUBLIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+int traceOpen(const char* filename, const int n_threads, const long n_events) {
+
+	if (posix_memalign((void**) &buffers, 64,
+			n_threads * sizeof(traceBuffer_t))) {
+		buffers = NULL;
+		printf("ERROR: Malloc failure");
+		return 1;
+	}
+	unsigned int i;
+	for (i = 0; i < n_threads; i++) {
+		buffers[i].events =
+				(traceEvent_t*) malloc(n_events * sizeof(traceEvent_t));
+		buffers[i].count = 0;
+		buffers[i].dropped = 0;
+		snprintf(buffers[i].name, TRACE_NAME, "thread %u", i);
+		if (!buffers[i].events) {
+			threads = i;
+			traceClose();
+			printf("ERROR: Malloc failure");
+			return 1;
+		}
+	}
+	threads = n_threads;
+	capacity = n_events;
+	traceFilename = filename;
+	start = now();
+
+	return 0;
+}
+
+void traceName(const int thread, const char* name) {
+
+	if (buffers && thread < threads) {
+		snprintf(buffers[thread].name, TRACE_NAME, "%s", name);
+	}
+}
+
+void traceBegin(const int thread, const char* name) {
+
+	record(thread, name, 1);
+}
+
+void traceEnd(const int thread, const char* name) {
+
+	record(thread, name, 0);
+}
+
+int traceClose(void) {
+
+	if (!buffers) {
+		return 0;
+	}
+
+	// Thread names, then the events of every thread
+	int failed = 0;
+	FILE* fp = traceFilename ? fopen(traceFilename, "w") : NULL;
+	if (fp) {
+		fprintf(fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+		const char* separator = "";
+		long dropped = 0;
+		unsigned int i;
+		for (i = 0; i < threads; i++) {
+			fprintf(fp, "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+					"\"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+					separator, i, buffers[i].name);
+			separator = ",\n";
+		}
+		for (i = 0; i < threads; i++) {
+			long j;
+			for (j = 0; j < buffers[i].count; j++) {
+				const traceEvent_t* event = buffers[i].events + j;
+				fprintf(fp, ",\n{\"name\": \"%s\", \"ph\": \"%s\", "
+						"\"ts\": %.3f, \"pid\": 1, \"tid\": %u}", event->name,
+						event->begin ? "B" : "E", event->time, i);
+			}
+			dropped += buffers[i].dropped;
+		}
+		fprintf(fp, "\n]}\n");
+		failed = fclose(fp) != 0;
+		if (dropped) {
+			printf("Trace: %ld events dropped, buffers full\n", dropped);
+		}
+	} else if (traceFilename) {
+		failed = 1;
+	}
+	if (failed) {
+		printf("%s\n", "ERROR: Failed to write trace file.");
+	}
+
+	unsigned int i;
+	for (i = 0; i < threads; i++) {
+		free(buffers[i].events);
+	}
+	free(buffers);
+	buffers = NULL;
+	threads = 0;
+	traceFilename = NULL;
+
+	return failed;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static double now(void) {
+
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+
+	return 1e6 * time.tv_sec + 1e-3 * time.tv_nsec;
+}
+
+static inline void record(const int thread, const char* name, const char begin) {
+
+	if (!buffers || thread >= threads) {
+		return;
+	}
+	traceBuffer_t* buffer = buffers + thread;
+	if (buffer->count < capacity) {
+		traceEvent_t* event = buffer->events + buffer->count++;
+		event->name = name;
+		event->begin = begin;
+		event->time = now() - start;
+	} else {
+		buffer->dropped++;
+	}
+}
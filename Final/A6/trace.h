@@ -0,0 +1,45 @@
+/**
+ *	trace.h
+ *	Contains a timeline of the phases of every thread
+ *
+ *	Threads record begin and end events of named phases into buffers of
+ *	their own, with no locks or atomics, so recording barely disturbs the
+ *	timeline. At the end the events are written as Chrome trace-event JSON,
+ *	which trace viewers such as chrome://tracing or Perfetto open. Load
+ *	imbalance shows as threads idle before a barrier or join. Shared by the
+ *	OpenMP and pthreads engines, which pass their own thread index.
+ */
+
+#pragma once
+
+/**
+ * Starts a trace of n_threads threads, numbered 0 to n_threads - 1, of at
+ * most n_events events per thread, to be written to filename. Later events
+ * of a full thread are dropped and counted.
+ *
+ * @return Returns 0 on success, else 1.
+ */
+int traceOpen(const char* filename, const int n_threads, const long n_events);
+
+/**
+ * Names thread in the trace viewer.
+ */
+void traceName(const int thread, const char* name);
+
+/**
+ * Records the begin of phase name on thread, the calling thread. Does
+ * nothing if no trace is open. name must outlive the trace.
+ */
+void traceBegin(const int thread, const char* name);
+
+/**
+ * Records the end of phase name on thread, the calling thread.
+ */
+void traceEnd(const int thread, const char* name);
+
+/**
+ * Writes the trace and stops tracing.
+ *
+ * @return Returns 0 on success, else 1.
+ */
+int traceClose(void);
@@ -0,0 +1,36 @@
+# Script for checking the MPI engine against the reference output, using
+# several ranks on this machine. Set MPIRUN to change how ranks are started.
+
+MPIRUN=${MPIRUN:-"mpirun --oversubscribe"}
+DATA=../../A6
+
+echo Checking that input_data is available
+ls -l $DATA/input_data/ellipse_N_00500.gal || exit 1
+
+echo Checking that ref_output_data is available
+ls -l $DATA/ref_output_data/ellipse_N_00500_after200steps.gal || exit 1
+
+echo Compiling compare_gal_files program
+gcc -o compare_gal_files $DATA/compare_gal_files/compare_gal_files.c -lm || exit 1
+
+for np in 1 2 3 4; do
+	echo Running with theta_max=0 using $np ranks, verify that result matches reference
+	$MPIRUN -np $np ./galsim 500 $DATA/input_data/ellipse_N_00500.gal 200 1e-5 0 0 1 || exit 1
+	./compare_gal_files 500 result.gal $DATA/ref_output_data/ellipse_N_00500_after200steps.gal > tmp.txt || exit 1
+	cat tmp.txt
+	grep pos_maxdiff tmp.txt | grep 00000000 || exit 1
+
+	echo Running with theta_max=0.1 using $np ranks and 2 threads, verify that we get smaller diff than 0.001
+	$MPIRUN -np $np ./galsim 500 $DATA/input_data/ellipse_N_00500.gal 200 1e-5 0.1 0 2 || exit 1
+	./compare_gal_files 500 result.gal $DATA/ref_output_data/ellipse_N_00500_after200steps.gal > tmp.txt || exit 1
+	cat tmp.txt
+	grep pos_maxdiff tmp.txt | grep 000 || exit 1
+	grep pos_maxdiff tmp.txt | grep 00000 && exit 1
+done
+
+rm -f tmp.txt compare_gal_files
+
+# If we get to this point, then all the different tests above have passed.
+echo
+echo All MPI checks passed
+echo
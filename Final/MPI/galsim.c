@@ -0,0 +1,802 @@
+#include "galsim.h"
+#include "io.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define KEY_BITS 8 // Bits per axis of the space-filling curve buckets
+#define N_BUCKETS (1 << (2 * KEY_BITS))
+#define RECORD_SIZE 8 // Doubles per particle sent between ranks
+#define GAL_RECORD 6 // Doubles per particle in a .gal file
+#define DYNAMIC_CHUNK 64 // Particles per chunk of the threaded force loop
+
+/*******************************************************************************
+  TYPES
+ *******************************************************************************/
+
+// Particles owned by this rank
+typedef struct domain {
+	long n; // Nr of particles on this rank
+	long capacity; // Allocated length of the arrays
+	particles_t particles;
+	double* brightness;
+	long* id; // Index of the particle in the input file
+	unsigned int* interactions; // Interactions during the last step
+} domain_t;
+
+// Growable list of pseudo-particles (x, y, mass), 3 doubles each
+typedef struct essentialList {
+	long n; // Nr of doubles
+	long capacity;
+	double* data;
+} essentialList_t;
+
+/*******************************************************************************
+  STATIC FUNCTION DECLARATIONS
+ *******************************************************************************/
+
+static void sliceOf(
+		const long N,
+		const int rank,
+		const int size,
+		long* __restrict first,
+		long* __restrict n);
+
+static int readParticles(
+		const char* filename,
+		const long N,
+		domain_t* __restrict domain,
+		const int rank,
+		const int size);
+
+static int writeParticles(
+		const char* filename,
+		const long N,
+		domain_t* __restrict domain,
+		MPI_Datatype record,
+		const int rank,
+		const int size);
+
+static void decompose(
+		domain_t* __restrict domain,
+		MPI_Datatype record,
+		const int size);
+
+static void migrate(
+		domain_t* __restrict domain,
+		const int* __restrict dest,
+		MPI_Datatype record,
+		const int size);
+
+static long exchangeEssential(
+		node_t* __restrict root,
+		domain_t* __restrict domain,
+		const double theta_max,
+		const int rank,
+		const int size,
+		particles_t* __restrict remote,
+		long* __restrict remoteCapacity);
+
+static void collectEssential(
+		node_t* __restrict node,
+		const double* __restrict box,
+		const double theta_max,
+		essentialList_t* __restrict list);
+
+static void updateDomain(
+		domain_t* __restrict domain,
+		node_t* __restrict root,
+		node_t* __restrict remoteRoot,
+		simulationConstants_t* __restrict simulationConstants);
+
+static void resizeDomain(domain_t* domain, const long n);
+
+static void freeDomain(domain_t* domain);
+
+static inline void packRecord(
+		const domain_t* __restrict domain,
+		const long i,
+		double* __restrict record);
+
+static inline void unpackRecord(
+		domain_t* __restrict domain,
+		const long i,
+		const double* __restrict record);
+
+static inline unsigned int curveBucket(double x, double y);
+
+/*******************************************************************************
+  FUNCTION DEFINITIONS
+ *******************************************************************************/
+
+// Simulate the movement of the particles over all ranks
+int simulateDistributed(
+		const char* filename,
+		const char* outputFilename,
+		simulationConstants_t* __restrict simulationConstants) {
+
+	// Extract simulation constants
+	const long N = *simulationConstants->N;
+	const int nsteps = *simulationConstants->nsteps;
+	const double theta_max = *simulationConstants->theta_max;
+
+	int rank;
+	int size;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+	// Set number of threads per rank
+	omp_set_num_threads(*simulationConstants->n_threads);
+
+	// Particles are sent as records, so MPI counts stay within an int up to
+	// INT_MAX particles per rank
+	MPI_Datatype record;
+	MPI_Type_contiguous(RECORD_SIZE, MPI_DOUBLE, &record);
+	MPI_Type_commit(&record);
+
+	// Every rank reads an equally large index range of the file to begin with
+	domain_t domain = {0};
+	if (readParticles(filename, N, &domain, rank, size)) {
+		MPI_Type_free(&record);
+		freeDomain(&domain);
+		return 1;
+	}
+
+	// Pseudo-particles received from the other ranks
+	particles_t remote = {0};
+	long remoteCapacity = 0;
+
+	// Create roots
+	node_t root;
+	node_t remoteRoot;
+
+	// Simulate
+	unsigned int i;
+	for (i = 0; i < nsteps; i++) {
+
+		// Rebalance along the curve using last step's cost
+		decompose(&domain, record, size);
+
+		// Build quadtree of this rank's particles
+		buildQuadtree(&domain.particles, domain.n, &root, NULL);
+
+		// Get the parts of the other ranks' trees this rank needs
+		const long n_remote = exchangeEssential(&root, &domain, theta_max,
+				rank, size, &remote, &remoteCapacity);
+		if (n_remote) {
+			buildQuadtree(&remote, n_remote, &remoteRoot, NULL);
+		}
+
+		// Update particles
+		updateDomain(&domain, &root, n_remote ? &remoteRoot : NULL,
+				simulationConstants);
+
+		// Free quadtrees
+		freeQuadtree(&root);
+		if (n_remote) {
+			freeQuadtree(&remoteRoot);
+		}
+	}
+
+	// Every rank writes the index range it read
+	const int failed = writeParticles(outputFilename, N, &domain, record,
+			rank, size);
+
+	MPI_Type_free(&record);
+	freeDomain(&domain);
+	free(remote.x);
+	free(remote.y);
+	free(remote.mass);
+
+	return failed;
+}
+
+/*******************************************************************************
+  STATIC FUNCTION DEFINITIONS
+ *******************************************************************************/
+
+/**
+ * Sets the index range of the particles rank reads and writes: contiguous and
+ * equally large, the first N % size ranks one particle more.
+ */
+static void sliceOf(
+		const long N,
+		const int rank,
+		const int size,
+		long* __restrict first,
+		long* __restrict n) {
+
+	const long base = N / size;
+	const long extra = N % size;
+	*first = rank * base + (rank < extra ? rank : extra);
+	*n = base + (rank < extra);
+}
+
+/**
+ * Reads the slice of this rank from the .gal or galaxy v2 file "filename",
+ * so no rank holds more than its share of the particles. A .gal slice is
+ * read with collective MPI-IO, a galaxy v2 file is mapped and only the pages
+ * of the slice are touched.
+ *
+ * @return Returns 0 on success, else 1 on every rank.
+ */
+static int readParticles(
+		const char* filename,
+		const long N,
+		domain_t* __restrict domain,
+		const int rank,
+		const int size) {
+
+	long first;
+	long n;
+	sliceOf(N, rank, size, &first, &n);
+	resizeDomain(domain, n);
+	int failed = n && !(domain->particles.x && domain->particles.y
+			&& domain->particles.v_x && domain->particles.v_y
+			&& domain->particles.mass && domain->brightness && domain->id
+			&& domain->interactions);
+	const char* error = failed ? "ERROR: Malloc failure" : NULL;
+	long i;
+
+	if (!failed && isGalaxyFile(filename)) {
+		// Galaxy v2 file: copy the slice of every column
+		particles_t columns;
+		double* brightnessColumn;
+		galaxyMap_t map = { NULL, 0 };
+		failed = mapGalaxy(&columns, &brightnessColumn, &map, filename);
+		if (failed) {
+			error = "ERROR: Failed to read input file.";
+		} else if (((galaxyHeader_t*) map.data)->N != N) {
+			error = "ERROR: Input file holds another N. Is N correct?";
+			failed = 1;
+		}
+		if (!failed) {
+			for (i = 0; i < n; i++) {
+				domain->particles.x[i] = columns.x[first + i];
+				domain->particles.y[i] = columns.y[first + i];
+				domain->particles.mass[i] = columns.mass[first + i];
+				domain->particles.v_x[i] = columns.v_x[first + i];
+				domain->particles.v_y[i] = columns.v_y[first + i];
+				domain->brightness[i] = brightnessColumn[first + i];
+			}
+		}
+		unmapGalaxy(&map);
+	} else if (!failed) {
+		// .gal file: read the records of the slice
+		MPI_File fh;
+		MPI_Offset fileSize = 0;
+		double* buffer = (double*) malloc((n ? n : 1) * GAL_RECORD
+				* sizeof(double));
+		if (MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_RDONLY,
+					MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+			error = "ERROR: Failed to open input file. Is it in directory?";
+			failed = 1;
+		} else {
+			MPI_File_get_size(fh, &fileSize);
+			if (fileSize != (MPI_Offset) N * GAL_RECORD * sizeof(double)) {
+				error = "ERROR: Input file size is not as expected. Is N correct?";
+				failed = 1;
+			} else {
+				MPI_Datatype galRecord;
+				MPI_Type_contiguous(GAL_RECORD, MPI_DOUBLE, &galRecord);
+				MPI_Type_commit(&galRecord);
+				failed = !buffer || MPI_File_read_at_all(fh,
+						(MPI_Offset) first * GAL_RECORD * sizeof(double),
+						buffer, n, galRecord, MPI_STATUS_IGNORE) != MPI_SUCCESS;
+				if (failed) {
+					error = "ERROR: Failed to read input file.";
+				}
+				MPI_Type_free(&galRecord);
+			}
+			MPI_File_close(&fh);
+		}
+		if (!failed) {
+			for (i = 0; i < n; i++) {
+				const double* values = buffer + i * GAL_RECORD;
+				domain->particles.x[i] = values[0];
+				domain->particles.y[i] = values[1];
+				domain->particles.mass[i] = values[2];
+				domain->particles.v_x[i] = values[3];
+				domain->particles.v_y[i] = values[4];
+				domain->brightness[i] = values[5];
+			}
+		}
+		free(buffer);
+	}
+	for (i = 0; i < n && !failed; i++) {
+		domain->id[i] = first + i;
+		domain->interactions[i] = 1;
+	}
+
+	// Fail together, reporting the first failing rank's error once
+	int failedRank = failed ? rank : size;
+	MPI_Allreduce(MPI_IN_PLACE, &failedRank, 1, MPI_INT, MPI_MIN,
+			MPI_COMM_WORLD);
+	if (failedRank < size && rank == failedRank) {
+		printf("%s\n", error);
+	}
+
+	return failedRank < size;
+}
+
+/**
+ * Sends every particle to the rank whose slice holds its index, puts it at
+ * its place there and writes every slice to the .gal file "filename" with
+ * collective MPI-IO.
+ *
+ * @return Returns 0 on success, else 1 on every rank.
+ */
+static int writeParticles(
+		const char* filename,
+		const long N,
+		domain_t* __restrict domain,
+		MPI_Datatype record,
+		const int rank,
+		const int size) {
+
+	// Rank of the slice holding every particle
+	const long base = N / size;
+	const long extra = N % size;
+	int* dest = (int*) malloc((domain->n ? domain->n : 1) * sizeof(int));
+	long i;
+	for (i = 0; i < domain->n; i++) {
+		const long id = domain->id[i];
+		dest[i] = id < extra * (base + 1) ? id / (base + 1) :
+				extra + (id - extra * (base + 1)) / base;
+	}
+	migrate(domain, dest, record, size);
+	free(dest);
+
+	// Interleave the slice into .gal records in the original order
+	long first;
+	long n;
+	sliceOf(N, rank, size, &first, &n);
+	double* buffer = (double*) malloc((n ? n : 1) * GAL_RECORD
+			* sizeof(double));
+	int failed = !buffer;
+	for (i = 0; i < domain->n && !failed; i++) {
+		double* values = buffer + (domain->id[i] - first) * GAL_RECORD;
+		values[0] = domain->particles.x[i];
+		values[1] = domain->particles.y[i];
+		values[2] = domain->particles.mass[i];
+		values[3] = domain->particles.v_x[i];
+		values[4] = domain->particles.v_y[i];
+		values[5] = domain->brightness[i];
+	}
+
+	// Write every slice at its place in the file
+	MPI_File fh;
+	if (MPI_File_open(MPI_COMM_WORLD, filename,
+				MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &fh)
+			!= MPI_SUCCESS) {
+		if (rank == 0) {
+			printf("%s\n", "ERROR: Failed to create output file");
+		}
+		free(buffer);
+		return 1;
+	}
+	MPI_File_set_size(fh, (MPI_Offset) N * GAL_RECORD * sizeof(double));
+	MPI_Datatype galRecord;
+	MPI_Type_contiguous(GAL_RECORD, MPI_DOUBLE, &galRecord);
+	MPI_Type_commit(&galRecord);
+	failed |= MPI_File_write_at_all(fh,
+			(MPI_Offset) first * GAL_RECORD * sizeof(double),
+			buffer, failed ? 0 : n, galRecord, MPI_STATUS_IGNORE)
+			!= MPI_SUCCESS;
+	MPI_Type_free(&galRecord);
+	failed |= MPI_File_close(&fh) != MPI_SUCCESS;
+	free(buffer);
+
+	// Fail together
+	MPI_Allreduce(MPI_IN_PLACE, &failed, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+	if (failed && rank == 0) {
+		printf("%s\n", "ERROR: Failed to write output file.");
+	}
+
+	return failed;
+}
+
+/**
+ * Moves the particles to the ranks owning them. The unit square is cut into
+ * N_BUCKETS buckets ordered along a Morton curve, and every rank owns a
+ * contiguous run of buckets holding an equal share of last step's
+ * interactions.
+ */
+static void decompose(
+		domain_t* __restrict domain,
+		MPI_Datatype record,
+		const int size) {
+
+	// Cost of every bucket over all ranks
+	unsigned int* bucket = (unsigned int*) malloc((domain->n ? domain->n : 1)
+			* sizeof(unsigned int));
+	double* cost = (double*) calloc(N_BUCKETS, sizeof(double));
+	long i;
+	for (i = 0; i < domain->n; i++) {
+		bucket[i] = curveBucket(domain->particles.x[i], domain->particles.y[i]);
+		cost[bucket[i]] += domain->interactions[i];
+	}
+	MPI_Allreduce(MPI_IN_PLACE, cost, N_BUCKETS, MPI_DOUBLE, MPI_SUM,
+			MPI_COMM_WORLD);
+
+	// Owner of every bucket, by the middle of its cost on the curve
+	double total = 0.0;
+	for (i = 0; i < N_BUCKETS; i++) {
+		total += cost[i];
+	}
+	int* owner = (int*) malloc(N_BUCKETS * sizeof(int));
+	double before = 0.0;
+	for (i = 0; i < N_BUCKETS; i++) {
+		const double middle = before + 0.5 * cost[i];
+		owner[i] = total > 0.0 ? (int) (middle * size / total) : 0;
+		if (owner[i] >= size) {
+			owner[i] = size - 1;
+		}
+		before += cost[i];
+	}
+
+	// Particles to every rank
+	int* dest = (int*) malloc((domain->n ? domain->n : 1) * sizeof(int));
+	for (i = 0; i < domain->n; i++) {
+		dest[i] = owner[bucket[i]];
+	}
+	migrate(domain, dest, record, size);
+
+	free(bucket);
+	free(cost);
+	free(owner);
+	free(dest);
+}
+
+/**
+ * Moves particle i of domain to rank dest[i], receiving the particles the
+ * other ranks move here.
+ */
+static void migrate(
+		domain_t* __restrict domain,
+		const int* __restrict dest,
+		MPI_Datatype record,
+		const int size) {
+
+	// Particles to every rank
+	int sendCounts[size];
+	int recvCounts[size];
+	int sendDispls[size];
+	int recvDispls[size];
+	memset(sendCounts, 0, sizeof(sendCounts));
+	long i;
+	for (i = 0; i < domain->n; i++) {
+		sendCounts[dest[i]]++;
+	}
+	MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT,
+			MPI_COMM_WORLD);
+
+	// Offsets in records
+	long n_recv = 0;
+	unsigned int r;
+	for (r = 0; r < size; r++) {
+		n_recv += recvCounts[r];
+		sendDispls[r] = r ? sendDispls[r - 1] + sendCounts[r - 1] : 0;
+		recvDispls[r] = r ? recvDispls[r - 1] + recvCounts[r - 1] : 0;
+	}
+
+	// Pack grouped by destination
+	double* sendBuf = (double*) malloc((size_t) (domain->n ? domain->n : 1)
+			* RECORD_SIZE * sizeof(double));
+	int offset[size];
+	for (r = 0; r < size; r++) {
+		offset[r] = sendDispls[r];
+	}
+	for (i = 0; i < domain->n; i++) {
+		packRecord(domain, i, sendBuf + (size_t) offset[dest[i]] * RECORD_SIZE);
+		offset[dest[i]]++;
+	}
+
+	// Exchange
+	double* recvBuf = (double*) malloc((size_t) (n_recv ? n_recv : 1)
+			* RECORD_SIZE * sizeof(double));
+	MPI_Alltoallv(sendBuf, sendCounts, sendDispls, record,
+			recvBuf, recvCounts, recvDispls, record, MPI_COMM_WORLD);
+
+	// Unpack
+	resizeDomain(domain, n_recv);
+	for (i = 0; i < n_recv; i++) {
+		unpackRecord(domain, i, recvBuf + (size_t) i * RECORD_SIZE);
+	}
+
+	free(sendBuf);
+	free(recvBuf);
+}
+
+/**
+ * Sends every other rank the nodes of this rank's quadtree that all of its
+ * particles would accept without opening, and receives the same from them.
+ * Returns the number of pseudo-particles received into remote.
+ */
+static long exchangeEssential(
+		node_t* __restrict root,
+		domain_t* __restrict domain,
+		const double theta_max,
+		const int rank,
+		const int size,
+		particles_t* __restrict remote,
+		long* __restrict remoteCapacity) {
+
+	// Bounding box of this rank's particles, empty if min > max
+	double box[4] = { 1.0, 1.0, -1.0, -1.0 };
+	long i;
+	for (i = 0; i < domain->n; i++) {
+		const double x = domain->particles.x[i];
+		const double y = domain->particles.y[i];
+		if (i == 0 || x < box[0]) box[0] = x;
+		if (i == 0 || y < box[1]) box[1] = y;
+		if (i == 0 || x > box[2]) box[2] = x;
+		if (i == 0 || y > box[3]) box[3] = y;
+	}
+	double boxes[4 * size];
+	MPI_Allgather(box, 4, MPI_DOUBLE, boxes, 4, MPI_DOUBLE, MPI_COMM_WORLD);
+
+	// Collect the essential nodes for every other non-empty rank
+	essentialList_t lists[size];
+	int sendCounts[size];
+	int recvCounts[size];
+	int sendDispls[size];
+	int recvDispls[size];
+	unsigned int r;
+	for (r = 0; r < size; r++) {
+		lists[r].n = 0;
+		lists[r].capacity = 0;
+		lists[r].data = NULL;
+		if (r != rank && boxes[4 * r] <= boxes[4 * r + 2] && root->mass) {
+			collectEssential(root, boxes + 4 * r, theta_max, lists + r);
+		}
+		sendCounts[r] = lists[r].n;
+	}
+	MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT,
+			MPI_COMM_WORLD);
+
+	// Pack
+	long n_send = 0;
+	long n_recv = 0;
+	for (r = 0; r < size; r++) {
+		sendDispls[r] = n_send;
+		recvDispls[r] = n_recv;
+		n_send += sendCounts[r];
+		n_recv += recvCounts[r];
+	}
+	double* sendBuf = (double*) malloc((n_send ? n_send : 1) * sizeof(double));
+	for (r = 0; r < size; r++) {
+		for (i = 0; i < lists[r].n; i++) {
+			sendBuf[sendDispls[r] + i] = lists[r].data[i];
+		}
+		free(lists[r].data);
+	}
+
+	// Exchange
+	double* recvBuf = (double*) malloc((n_recv ? n_recv : 1) * sizeof(double));
+	MPI_Alltoallv(sendBuf, sendCounts, sendDispls, MPI_DOUBLE,
+			recvBuf, recvCounts, recvDispls, MPI_DOUBLE, MPI_COMM_WORLD);
+
+	// Unpack
+	const long n_remote = n_recv / 3;
+	if (n_remote > *remoteCapacity) {
+		remote->x = (double*) realloc(remote->x, n_remote * sizeof(double));
+		remote->y = (double*) realloc(remote->y, n_remote * sizeof(double));
+		remote->mass = (double*) realloc(remote->mass,
+				n_remote * sizeof(double));
+		*remoteCapacity = n_remote;
+	}
+	for (i = 0; i < n_remote; i++) {
+		remote->x[i] = recvBuf[3 * i];
+		remote->y[i] = recvBuf[3 * i + 1];
+		remote->mass[i] = recvBuf[3 * i + 2];
+	}
+
+	free(sendBuf);
+	free(recvBuf);
+
+	return n_remote;
+}
+
+/**
+ * Adds the nodes below node that every particle inside box accepts to list.
+ * Leaves are always added, other nodes are opened unless they pass the
+ * opening criterion of calculateForces() at the shortest distance from box.
+ *
+ * @param node      Recursive node of quadtree
+ * @param box       Bounding box of the receiving rank (xmin, ymin, xmax, ymax)
+ * @param theta_max Opening criterion
+ * @param list      List to add (x, y, mass) of accepted nodes to
+ */
+static void collectEssential(
+		node_t* __restrict node,
+		const double* __restrict box,
+		const double theta_max,
+		essentialList_t* __restrict list) {
+
+	// Empty leaf
+	if (!node->mass) {
+		return;
+	}
+
+	if (node->children) {
+		// Shortest distance from box to center of mass
+		double dx = 0.0;
+		double dy = 0.0;
+		if (node->xCenterOfMass < box[0]) dx = box[0] - node->xCenterOfMass;
+		if (node->xCenterOfMass > box[2]) dx = node->xCenterOfMass - box[2];
+		if (node->yCenterOfMass < box[1]) dy = box[1] - node->yCenterOfMass;
+		if (node->yCenterOfMass > box[3]) dy = node->yCenterOfMass - box[3];
+		const double r = sqrt(dx*dx + dy*dy);
+
+		// Open node if any particle in box could open it
+		if ((node->sideHalf + node->sideHalf) > theta_max * r) {
+			unsigned int i;
+			for (i = 0; i < 4; i++) {
+				collectEssential(node->children + i, box, theta_max, list);
+			}
+			return;
+		}
+	}
+
+	// Add node as pseudo-particle
+	if (list->n + 3 > list->capacity) {
+		list->capacity = list->capacity ? 2 * list->capacity : 3 * 256;
+		list->data = (double*) realloc(list->data,
+				list->capacity * sizeof(double));
+	}
+	list->data[list->n++] = node->xCenterOfMass;
+	list->data[list->n++] = node->yCenterOfMass;
+	list->data[list->n++] = node->mass;
+}
+
+/**
+ * Updates acceleration, velocity and position of this rank's particles from
+ * the local quadtree and the quadtree of remote pseudo-particles (if any).
+ */
+static void updateDomain(
+		domain_t* __restrict domain,
+		node_t* __restrict root,
+		node_t* __restrict remoteRoot,
+		simulationConstants_t* __restrict simulationConstants) {
+
+	// Get some constants on stack for speedup
+	const double G = *(simulationConstants->G);
+	const double eps0 = *(simulationConstants->eps0);
+	const double delta_t = *(simulationConstants->delta_t);
+	const double theta_max = *(simulationConstants->theta_max);
+	const long n = domain->n;
+	particles_t* particles = &domain->particles;
+
+	// Loop particles
+	long i;
+	#pragma omp parallel for schedule(dynamic, DYNAMIC_CHUNK)
+	for (i = 0; i < n; i++) {
+
+		// Set acceleration to zero
+		double a_x = 0.0;
+		double a_y = 0.0;
+		const double x = particles->x[i];
+		const double y = particles->y[i];
+
+		// Update acceleration
+		domain->interactions[i] = 0;
+		calculateForces(
+				x, y,
+				root,
+				G, eps0, delta_t, theta_max,
+				&a_x, &a_y, &domain->interactions[i]);
+		if (remoteRoot) {
+			calculateForces(
+					x, y,
+					remoteRoot,
+					G, eps0, delta_t, theta_max,
+					&a_x, &a_y, &domain->interactions[i]);
+		}
+
+		// Update velocity
+		particles->v_x[i] += -G * delta_t * a_x;
+		particles->v_y[i] += -G * delta_t * a_y;
+
+		// Update position
+		particles->x[i] += delta_t * particles->v_x[i];
+		particles->y[i] += delta_t * particles->v_y[i];
+	}
+}
+
+/**
+ * Sets the number of particles of domain, growing its arrays if needed.
+ */
+static void resizeDomain(domain_t* domain, const long n) {
+
+	if (n > domain->capacity) {
+		domain->particles.x = (double*) realloc(domain->particles.x,
+				n * sizeof(double));
+		domain->particles.y = (double*) realloc(domain->particles.y,
+				n * sizeof(double));
+		domain->particles.v_x = (double*) realloc(domain->particles.v_x,
+				n * sizeof(double));
+		domain->particles.v_y = (double*) realloc(domain->particles.v_y,
+				n * sizeof(double));
+		domain->particles.mass = (double*) realloc(domain->particles.mass,
+				n * sizeof(double));
+		domain->brightness = (double*) realloc(domain->brightness,
+				n * sizeof(double));
+		domain->id = (long*) realloc(domain->id, n * sizeof(long));
+		domain->interactions = (unsigned int*) realloc(domain->interactions,
+				n * sizeof(unsigned int));
+		domain->capacity = n;
+	}
+	domain->n = n;
+}
+
+static void freeDomain(domain_t* domain) {
+
+	free(domain->particles.x);
+	free(domain->particles.y);
+	free(domain->particles.v_x);
+	free(domain->particles.v_y);
+	free(domain->particles.mass);
+	free(domain->brightness);
+	free(domain->id);
+	free(domain->interactions);
+}
+
+/**
+ * Packs particle i as (x, y, mass, v_x, v_y, brightness, id, interactions),
+ * the first six in .gal order.
+ */
+static inline void packRecord(
+		const domain_t* __restrict domain,
+		const long i,
+		double* __restrict record) {
+
+	record[0] = domain->particles.x[i];
+	record[1] = domain->particles.y[i];
+	record[2] = domain->particles.mass[i];
+	record[3] = domain->particles.v_x[i];
+	record[4] = domain->particles.v_y[i];
+	record[5] = domain->brightness[i];
+	if (domain->id) {
+		record[6] = domain->id[i];
+		record[7] = domain->interactions[i];
+	}
+}
+
+static inline void unpackRecord(
+		domain_t* __restrict domain,
+		const long i,
+		const double* __restrict record) {
+
+	domain->particles.x[i] = record[0];
+	domain->particles.y[i] = record[1];
+	domain->particles.mass[i] = record[2];
+	domain->particles.v_x[i] = record[3];
+	domain->particles.v_y[i] = record[4];
+	domain->brightness[i] = record[5];
+	domain->id[i] = (long) record[6];
+	domain->interactions[i] = (unsigned int) record[7];
+}
+
+/**
+ * Returns the bucket of (x, y) along a Morton curve over the unit square,
+ * KEY_BITS bits per axis. Positions outside the square go to its edge.
+ */
+static inline unsigned int curveBucket(double x, double y) {
+
+	const int side = 1 << KEY_BITS;
+	int ix = (int) (x * side);
+	int iy = (int) (y * side);
+	ix = ix < 0 ? 0 : (ix >= side ? side - 1 : ix);
+	iy = iy < 0 ? 0 : (iy >= side ? side - 1 : iy);
+
+	// Interleave the bits of ix and iy
+	unsigned int key = 0;
+	unsigned int bit;
+	for (bit = 0; bit < KEY_BITS; bit++) {
+		key |= ((ix >> bit) & 1u) << (2 * bit);
+		key |= ((iy >> bit) & 1u) << (2 * bit + 1);
+	}
+
+	return key;
+}
@@ -0,0 +1,34 @@
+/**
+ *	galsim.h
+ *	Contains functions for simulating the interactions between particles,
+ *	distributed over MPI ranks
+ *
+ */
+
+#pragma once
+#include "modules.h"
+#include <math.h>
+#include "quadtree.h"
+#include <mpi.h>
+#include <omp.h>
+
+/**
+ * Simulates the movement of all the particles, distributed over all ranks of
+ * MPI_COMM_WORLD. Every rank reads an equal, contiguous share of the
+ * particles from the input file and writes the same share of the output
+ * file, so no rank ever holds more than its share. In between, the particles
+ * are split between the ranks along a space-filling curve, rebalanced every
+ * timestep by the measured cost of the previous step. Every rank builds a
+ * quadtree of its own particles and receives the parts of the other ranks'
+ * trees it needs (the locally essential tree). Each rank runs n_threads
+ * OpenMP threads.
+ *
+ * @param filename            Input .gal or galaxy v2 file.
+ * @param outputFilename      Output .gal file.
+ * @param simulationConstants Simulation constants, the same on every rank.
+ * @return                    Returns 0 on success, else 1 on every rank.
+ */
+int simulateDistributed(
+		const char* filename,
+		const char* outputFilename,
+		simulationConstants_t* __restrict simulationConstants);
@@ -0,0 +1,100 @@
+// RUN BY:
+// mpirun -np 4 ./galsim 05000 ../../A6/input_data/ellipse_N_05000.gal 100 0.00001 0.1 0 1
+//
+// Same arguments as the OpenMP engine, n_threads is the number of threads per
+// rank. Graphics are not supported and must be 0.
+//
+// Optional flags after the positional arguments:
+// --output <file>                      Output file (result.gal)
+//
+// Every rank reads and writes only its share of the particles, with MPI-IO
+// for .gal files, so the particles never have to fit in one node's memory.
+
+/**
+ * Simulates galaxy movement in outer space, distributed over MPI ranks.
+ *
+ * Original authors: Olof Björck, Gunnlaugur Geirsson
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modules.h"
+#include "galsim.h"
+#include "quadtree.h"
+
+/**
+ * Main function
+ *
+ */
+int main(int argc, char *argv[]) {
+
+	// Threads only call MPI from the main thread
+	int provided;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+	// Check proper number of input arguments
+	if (argc < 8) {
+		if (rank == 0) {
+			printf("%s\n", "Input error: Expected 7 input arguments");
+		}
+		MPI_Finalize();
+		return 1;
+	}
+
+	// Read input from command line
+	const long N = atol(argv[1]); // Nr of stars to simulate
+	const char* filename = argv[2]; // Filename
+	const int nsteps = atoi(argv[3]); // Nr of filesteps
+	const double delta_t = atof(argv[4]); // Timestep
+	const double theta_max = atof(argv[5]);
+	const int graphics = atoi(argv[6]); // Graphics on/off as 1/0
+	const int n_threads = atoi(argv[7]); // Number of threads per rank
+
+	// Read optional flags from command line
+	const char* outputFilename = "result.gal";
+	unsigned int i;
+	for (i = 8; i < argc; i++) {
+		if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+			outputFilename = argv[++i];
+		} else {
+			if (rank == 0) {
+				printf("Input error: Unknown option %s\n", argv[i]);
+			}
+			MPI_Finalize();
+			return 1;
+		}
+	}
+
+	if (graphics) {
+		if (rank == 0) {
+			printf("%s\n", "Input error: Graphics are not supported with MPI");
+		}
+		MPI_Finalize();
+		return 1;
+	}
+
+	// Constants for the simulation
+	const double G = 100.0/N; // Gravitational constant
+	const double eps0 = 0.001; // Plummer sphere constant
+
+	// Add the simulation constants to struct
+	simulationConstants_t simulationConstants = {0};
+	simulationConstants.N = &N;
+	simulationConstants.nsteps = &nsteps;
+	simulationConstants.delta_t = &delta_t;
+	simulationConstants.theta_max = &theta_max;
+	simulationConstants.n_threads = &n_threads;
+	simulationConstants.G = &G;
+	simulationConstants.eps0 = &eps0;
+
+	// Simulate, every rank reading and writing its share of the particles
+	const int failed = simulateDistributed(filename, outputFilename,
+			&simulationConstants);
+
+	MPI_Finalize();
+
+	return failed;
+}